@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <random>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#if defined(_MSC_VER)
+#pragma comment(lib, "psapi.lib")
+#endif
+#else
+#include <sys/resource.h>
+#endif
+
+#include "Benchmark.h"
+#include "BlockCodec.h"
+#include "Codebook.h"
+#include "DecodeTable.h"
+#include "FrequencyMap.h"
+#include "HuffmanCompressor.h"
+
+
+
+/* Benchmark
+   ---------
+   Per-phase timings of the compressor over a corpus.
+*/
+
+
+
+/* Constructor */
+
+Benchmark::Benchmark(size_t nRuns) :
+    nRuns((nRuns == 0) ? 1 : nRuns) {
+}
+
+
+
+/* Public Interface */
+
+/* standardCorpus
+   --------------
+   Builds every case from a fixed seed. The skewed case draws bytes
+   from a geometric distribution, so a few bytes make up most of it
+   and the rest get long codes.
+*/
+
+vector<Benchmark::Case> Benchmark::standardCorpus() {
+    vector<Case> corpus(6);
+    mt19937 random(20200401);
+
+    corpus[0].name = "random";
+    corpus[0].data.resize(CASE_SIZE);
+    for (uint8_t& byte : corpus[0].data) {
+        byte = (uint8_t)random();
+    }
+
+    corpus[1].name = "pattern";
+    corpus[1].data.resize(CASE_SIZE);
+    for (size_t i = 0; i < CASE_SIZE; i++) {
+        corpus[1].data[i] = (uint8_t)i;
+    }
+
+    corpus[2].name = "text";
+    generateText(corpus[2].data, CASE_SIZE, 1);
+
+    corpus[3].name = "skewed";
+    corpus[3].data.resize(CASE_SIZE);
+    geometric_distribution<uint32_t> geometric(0.3);
+    for (uint8_t& byte : corpus[3].data) {
+        byte = (uint8_t)min<uint32_t>(geometric(random), 255);
+    }
+
+    corpus[4].name = "single";
+    corpus[4].data.assign(CASE_SIZE, 'a');
+
+    corpus[5].name = "large";
+    generateText(corpus[5].data, LARGE_CASE_SIZE, 2);
+
+    return corpus;
+}
+
+
+/* loadCase
+   --------
+   Reads the file in one go.
+*/
+
+bool Benchmark::loadCase(string filename, Case& benchmarkCase) {
+    ifstream infile(filename, ios::binary);
+    if (!infile) {
+        return false;
+    }
+    benchmarkCase.name = filename;
+    benchmarkCase.data.assign(istreambuf_iterator<char>(infile), istreambuf_iterator<char>());
+    return !infile.bad();
+}
+
+
+/* run
+   ---
+   The phases are run in the order compression does them, each on the
+   results of the one before. The first lines wait for the encode, so
+   that they can report its ratio. The encode and decode phases code the
+   whole case as one stream, so they measure the coding loops alone,
+   without blocks or threads.
+*/
+
+void Benchmark::run(const Case& benchmarkCase, ostream& out) const {
+    const uint8_t* data = benchmarkCase.data.data();
+    size_t size = benchmarkCase.data.size();
+    double originalSize = (double)max<size_t>(size, 1);
+
+    /* Histogram */
+
+    unique_ptr<FrequencyMap> freqMap;
+    double histogramSeconds = fastestTime([&] {
+        freqMap.reset(new FrequencyMap(data, size));
+    });
+
+    /* Tree */
+
+    uint8_t lengths[Codebook::NUM_SYMBOLS];
+    unique_ptr<Codebook> codebook;
+    unique_ptr<DecodeTable> table;
+    double treeSeconds = fastestTime([&] {
+        Codebook::buildLengths(*freqMap, HuffmanCompressor::Options().maxCodeLength, lengths);
+        codebook.reset(new Codebook(lengths));
+        table.reset(new DecodeTable(*codebook));
+    });
+
+    /* Encode, with room for the longest codes and the writer's slack */
+
+    vector<uint8_t> encoded(size / 8 * codebook->maxLength() + 2 * codebook->maxLength() + 8);
+    size_t encodedSize = 0;
+    double encodeSeconds = fastestTime([&] {
+        encodedSize = BlockCodec::encode(*codebook, data, size, encoded.data());
+    });
+    double ratio = encodedSize / originalSize;
+    writeResult(out, benchmarkCase, "histogram", histogramSeconds, ratio);
+    writeResult(out, benchmarkCase, "tree", treeSeconds, ratio);
+    writeResult(out, benchmarkCase, "encode", encodeSeconds, ratio);
+
+    /* Decode */
+
+    vector<uint8_t> decoded(size);
+    bool decodedAll = false;
+    double seconds = fastestTime([&] {
+        decodedAll = BlockCodec::decode(*table, encoded.data(), encodedSize, decoded.data(), decoded.size());
+    });
+    writeResult(out, benchmarkCase, decodedAll && decoded == benchmarkCase.data ? "decode" : "decode_failed",
+                seconds, ratio);
+
+    /* Compress and decompress with the default options */
+
+    HuffmanCompressor compressor;
+    vector<uint8_t> compressed;
+    seconds = fastestTime([&] {
+        compressor.compressBuffer(data, size, compressed);
+    });
+    ratio = compressed.size() / originalSize;
+    writeResult(out, benchmarkCase, "compress", seconds, ratio);
+
+    bool decompressed = false;
+    seconds = fastestTime([&] {
+        decompressed = compressor.decompressBuffer(compressed.data(), compressed.size(), decoded);
+    });
+    writeResult(out, benchmarkCase, decompressed && decoded == benchmarkCase.data ? "decompress" : "decompress_failed",
+                seconds, ratio);
+}
+
+
+/* writeHeader */
+
+void Benchmark::writeHeader(ostream& out) {
+    out << "case\tbytes\tphase\tseconds\tmb_per_s\tratio\tpeak_kb" << endl;
+}
+
+
+
+/* Private Methods */
+
+/* fastestTime
+   -----------
+   Runs a phase nRuns times and returns the fastest, in seconds, which
+   is the least disturbed by whatever else the machine was doing.
+*/
+
+double Benchmark::fastestTime(const function<void()>& phase) const {
+    double fastest = 0;
+    for (size_t run = 0; run < nRuns; run++) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        phase();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (run == 0 || seconds < fastest) {
+            fastest = seconds;
+        }
+    }
+    return fastest;
+}
+
+
+/* writeResult
+   -----------
+   Writes one line of results. Speeds are in megabytes of original
+   data per second, whichever way the phase goes.
+*/
+
+void Benchmark::writeResult(ostream& out, const Case& benchmarkCase, const string& phase,
+                            double seconds, double ratio) {
+    double megabytesPerSecond = (seconds > 0) ? benchmarkCase.data.size() / seconds / 1e6 : 0;
+    out << benchmarkCase.name << "\t" << benchmarkCase.data.size() << "\t" << phase << "\t"
+        << seconds << "\t" << megabytesPerSecond << "\t" << ratio << "\t" << peakMemoryKB() << endl;
+}
+
+
+/* generateText
+   ------------
+   Makes up a vocabulary of words, then strings them together with a
+   Zipf distribution, the way words turn up in real text, into lines
+   with some capitals and punctuation.
+*/
+
+void Benchmark::generateText(vector<uint8_t>& data, size_t size, uint32_t seed) {
+    const size_t nWords = 4000;
+    mt19937 random(seed);
+
+    vector<string> words(nWords);
+    uniform_int_distribution<int> wordLength(1, 10);
+    const string letters = "etaoinshrdlcumwfgypbvkjxqz";
+    for (string& word : words) {
+        for (int i = wordLength(random); i > 0; i--) {
+            word += letters[(size_t)(letters.size() * pow(random() / 4294967296.0, 1.8))];
+        }
+    }
+
+    vector<double> weights(nWords);
+    for (size_t i = 0; i < nWords; i++) {
+        weights[i] = 1.0 / (i + 1);
+    }
+    discrete_distribution<size_t> zipf(weights.begin(), weights.end());
+
+    data.clear();
+    data.reserve(size + 16);
+    for (size_t nWordsInLine = 0; data.size() < size; nWordsInLine++) {
+        const string& word = words[zipf(random)];
+        data.insert(data.end(), word.begin(), word.end());
+        if (nWordsInLine == 0) {
+            data[data.size() - word.size()] = (uint8_t)toupper(word[0]);
+        }
+
+        uint32_t next = random() % 100;
+        if (next < 4) {
+            data.push_back('.');
+            data.push_back('\n');
+            nWordsInLine = (size_t)-1;
+        }
+        else {
+            if (next < 10) {
+                data.push_back(',');
+            }
+            data.push_back(' ');
+        }
+    }
+    data.resize(size);
+}
+
+
+/* peakMemoryKB
+   ------------
+   The most memory the process has held at once, in kilobytes.
+*/
+
+size_t Benchmark::peakMemoryKB() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize / 1024;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return (size_t)usage.ru_maxrss / 1024;
+#else
+    return (size_t)usage.ru_maxrss;
+#endif
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,119 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+
+/* Benchmark
+   ---------
+   Times each phase of compression on a corpus of inputs, so that two
+   builds can be compared and regressions caught before they ship.
+
+   The phases are counting the bytes (histogram), building the codes
+   and decode table from the counts (tree), Huffman coding the whole
+   input with them in one thread (encode) and decoding it back (decode),
+   then the full compressBuffer and decompressBuffer with the default
+   options (compress and decompress). Each phase is run several times
+   and the fastest time is kept.
+
+   The results are written as tab separated lines, one per input and
+   phase, under a header line, so they can be diffed or loaded straight
+   into a spreadsheet:
+
+       case  bytes  phase  seconds  mb_per_s  ratio  peak_kb
+
+   The ratio is compressed over original size: from the Huffman codes
+   alone for the first four phases, and from the whole format for the
+   last two. peak_kb is the most memory the process has held so far.
+*/
+
+
+
+class Benchmark {
+public:
+
+    /* Case
+       ----
+       One input of the corpus, and the name it is reported under.
+    */
+
+    struct Case {
+        string name;
+        vector<uint8_t> data;
+    };
+
+
+    /* Constants */
+
+    static const size_t CASE_SIZE = 8 << 20;
+    static const size_t LARGE_CASE_SIZE = 64 << 20;
+
+
+    /* Constructor */
+
+    Benchmark(size_t nRuns = 3);
+
+
+    /* Public Interface */
+
+
+    /* standardCorpus
+       --------------
+       Generates the standard corpus: random bytes, the repeating 0 to
+       255 pattern of createTestFile, English-like text, a skewed
+       distribution, a single repeated byte and a large text input. The
+       same seed is used every time, so every build sees the same bytes.
+    */
+
+    static vector<Case> standardCorpus();
+
+
+    /* loadCase
+       --------
+       Reads a whole file as a case named after it. Returns false if
+       the file could not be read.
+    */
+
+    static bool loadCase(string filename, Case& benchmarkCase);
+
+
+    /* run
+       ---
+       Times every phase on one case and writes a line for each to out.
+    */
+
+    void run(const Case& benchmarkCase, ostream& out) const;
+
+
+    /* writeHeader
+       -----------
+       Writes the line naming the columns.
+    */
+
+    static void writeHeader(ostream& out);
+
+
+private:
+
+    /* Private Variables */
+
+    size_t nRuns;
+
+
+    /* Private Methods */
+
+    double fastestTime(const function<void()>& phase) const;
+
+    static void writeResult(ostream& out, const Case& benchmarkCase, const string& phase,
+                            double seconds, double ratio);
+
+    static void generateText(vector<uint8_t>& data, size_t size, uint32_t seed);
+
+    static size_t peakMemoryKB();
+
+};
\ No newline at end of file
@@ -0,0 +1,24 @@
+#include "BitReader.h"
+
+
+
+/* BitReader
+   ---------
+   Reads a bitstream in memory most significant bit first
+   through a 64-bit buffer.
+*/
+
+
+
+/* Constructors */
+
+/* A reader with no bits at all */
+
+BitReader::BitReader() {
+}
+
+/* Reads the first nBits bits of the nBytes bytes at data */
+
+BitReader::BitReader(const uint8_t* data, size_t nBytes, uint64_t nBits) :
+    totalBits(nBits), cursor(data), end(data + nBytes) {
+}
\ No newline at end of file
@@ -0,0 +1,152 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+
+
+/* BitReader
+   ---------
+   Reads a compressed bitstream in memory most significant bit first,
+   which is the same order the compressor fills its masks in.
+
+   Bits are kept in a 64-bit buffer that is topped up with a single
+   8 byte load whenever possible, so a decoder can peek at up to 57
+   bits at a time instead of isolating them one by one.
+
+   The reader is small and cheap to copy on purpose. Decoders keep
+   a local copy in their hot loops so that the compiler can hold the
+   whole state in registers.
+*/
+
+
+
+class BitReader {
+public:
+
+    /* Constructors */
+
+    BitReader();
+
+    BitReader(const uint8_t* data, size_t nBytes, uint64_t nBits);
+
+
+    /* Public Interface */
+
+
+    /* refill
+       ------
+       Tops up the bit buffer so that at least 57 bits are available,
+       unless the end of the data has been reached.
+    */
+
+    inline void refill();
+
+
+    /* peek
+       ----
+       Returns the next nBits (1 to 32) bits without consuming them.
+    */
+
+    inline uint32_t peek(uint32_t nBits) const;
+
+
+    /* consume
+       -------
+       Drops nBits bits from the front of the buffer.
+    */
+
+    inline void consume(uint32_t nBits);
+
+
+    /* bitsRemaining
+       -------------
+       Returns how many valid bits of the stream are left to be consumed.
+    */
+
+    inline uint64_t bitsRemaining() const;
+
+
+    /* bitsConsumed
+       ------------
+       Returns how many bits have been consumed since the start of the data.
+    */
+
+    inline uint64_t bitsConsumed() const;
+
+
+private:
+
+    /* Private Variables */
+
+    uint64_t buffer = 0;
+    uint32_t bitCount = 0;
+    uint64_t consumed = 0;
+    uint64_t totalBits = 0;
+
+    const uint8_t* cursor = nullptr;
+    const uint8_t* end = nullptr;
+
+};
+
+
+
+/* Inline Methods */
+
+/* loadBigEndian64
+   ---------------
+   Loads 8 bytes so that the first byte ends up in the most
+   significant position of the result.
+*/
+
+inline uint64_t loadBigEndian64(const uint8_t* bytes) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+#if defined(_MSC_VER)
+    return _byteswap_uint64(word);
+#else
+    return __builtin_bswap64(word);
+#endif
+}
+
+inline void BitReader::refill() {
+    if (end - cursor >= 8) {
+        uint64_t word = loadBigEndian64(cursor);
+
+        /* Any bits loaded past bitCount are the true next bits of the stream,
+           so they can safely be or'ed in again by the next refill. */
+
+        buffer |= word >> bitCount;
+        cursor += (63 - bitCount) >> 3;
+        bitCount |= 56;
+    }
+    else {
+
+        /* Near the end of the data, top up one byte at a time */
+
+        while (bitCount <= 56 && cursor < end) {
+            buffer |= (uint64_t)(*cursor++) << (56 - bitCount);
+            bitCount += 8;
+        }
+    }
+}
+
+inline uint32_t BitReader::peek(uint32_t nBits) const {
+    return (uint32_t)(buffer >> (64 - nBits));
+}
+
+inline void BitReader::consume(uint32_t nBits) {
+    buffer <<= nBits;
+    bitCount -= nBits;
+    consumed += nBits;
+}
+
+inline uint64_t BitReader::bitsRemaining() const {
+    return totalBits - consumed;
+}
+
+inline uint64_t BitReader::bitsConsumed() const {
+    return consumed;
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#include "BitWriter.h"
+
+
+
+/* BitWriter
+   ---------
+   Packs codes most significant bit first through a
+   64-bit accumulator.
+*/
+
+
+
+/* Constructor */
+
+BitWriter::BitWriter(uint8_t* out) :
+    begin(out), cursor(out) {
+}
+
+
+
+/* Public Interface */
+
+/* restart
+   -------
+   Points the writer at a new output buffer. The leftover bits
+   are still in the accumulator, so nothing else needs to move.
+*/
+
+void BitWriter::restart(uint8_t* out) {
+    begin = out;
+    cursor = out;
+}
+
+
+/* finish
+   ------
+   Stores the last partial byte, if there is one, and returns
+   how many zeros were used to pad it out.
+*/
+
+uint32_t BitWriter::finish() {
+    uint32_t padding = (8 - bitCount) & 7;
+    if (bitCount > 0) {
+        *cursor++ = (uint8_t)(bitBuffer >> 56);
+    }
+    bitBuffer = 0;
+    bitCount = 0;
+    return padding;
+}
\ No newline at end of file
@@ -0,0 +1,123 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+
+
+/* BitWriter
+   ---------
+   Packs codes most significant bit first into a 64-bit accumulator,
+   and stores every whole byte of it straight into an output buffer
+   with a single 8 byte store.
+
+   The writer does no bounds checking. Whoever owns the output buffer
+   must leave room for the worst case, plus 8 bytes of slack for the
+   store. Like the BitReader it is cheap to copy so that hot loops
+   can keep it in registers.
+*/
+
+
+
+class BitWriter {
+public:
+
+    /* Constants */
+
+    static const uint32_t MAX_WRITE_BITS = 57;
+
+
+    /* Constructor */
+
+    BitWriter(uint8_t* out);
+
+
+    /* Public Interface */
+
+
+    /* write
+       -----
+       Appends the low nBits (1 to MAX_WRITE_BITS) bits of bits, which
+       can be one code or several that were joined together first.
+    */
+
+    inline void write(uint64_t bits, uint32_t nBits);
+
+
+    /* bytesWritten
+       ------------
+       Returns how many whole bytes have been stored since the
+       output buffer was last set.
+    */
+
+    inline size_t bytesWritten() const;
+
+
+    /* restart
+       -------
+       Points the writer at a new output buffer, for after the whole
+       bytes have been drained from the old one. Any bits of the last
+       partial byte are kept and land at the front of the new buffer.
+    */
+
+    void restart(uint8_t* out);
+
+
+    /* finish
+       ------
+       Pads the last partial byte with zeros and stores it. Returns
+       the number of padding bits (0 to 7).
+    */
+
+    uint32_t finish();
+
+
+private:
+
+    /* Private Variables */
+
+    uint64_t bitBuffer = 0;
+    uint32_t bitCount = 0;
+
+    uint8_t* begin = nullptr;
+    uint8_t* cursor = nullptr;
+
+};
+
+
+
+/* Inline Methods */
+
+/* storeBigEndian64
+   ----------------
+   Stores 8 bytes so that the most significant byte of word
+   ends up first.
+*/
+
+inline void storeBigEndian64(uint8_t* bytes, uint64_t word) {
+#if defined(_MSC_VER)
+    word = _byteswap_uint64(word);
+#else
+    word = __builtin_bswap64(word);
+#endif
+    memcpy(bytes, &word, sizeof(word));
+}
+
+/* At most 7 bits are ever left over between writes, so up to
+   MAX_WRITE_BITS bits always fit in the accumulator. */
+
+inline void BitWriter::write(uint64_t bits, uint32_t nBits) {
+    bitBuffer |= bits << (64 - bitCount - nBits);
+    bitCount += nBits;
+
+    storeBigEndian64(cursor, bitBuffer);
+    cursor += bitCount >> 3;
+    bitBuffer <<= bitCount & ~7u;
+    bitCount &= 7;
+}
+
+inline size_t BitWriter::bytesWritten() const {
+    return cursor - begin;
+}
\ No newline at end of file
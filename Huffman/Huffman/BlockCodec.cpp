@@ -0,0 +1,521 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "BitReader.h"
+#include "BitWriter.h"
+#include "BlockCodec.h"
+#include "ContextModel.h"
+#include "LZCoder.h"
+#include "CpuFeatures.h"
+#include "FrequencyMap.h"
+
+
+
+/* BlockCodec
+   ----------
+   Compresses and decompresses single blocks in memory.
+*/
+
+
+
+/* Constructors */
+
+/* Without a shared codebook, every block builds its own codes */
+
+BlockCodec::BlockCodec(uint32_t maxCodeLength, bool splitStreams, bool contextCodes, uint32_t lzLevel) :
+    maxCodeLength(maxCodeLength), splitStreams(splitStreams), contextCodes(contextCodes), lzLevel(lzLevel) {
+}
+
+/* The decode table for the shared codebook is built once here and
+   then used by every block, from any thread. */
+
+BlockCodec::BlockCodec(const Codebook& sharedCodebook, bool splitStreams, bool contextCodes, uint32_t lzLevel) :
+    splitStreams(splitStreams), contextCodes(contextCodes), lzLevel(lzLevel), sharedCodebook(&sharedCodebook), sharedTable(new DecodeTable(sharedCodebook)) {
+}
+
+
+
+/* Compression Methods */
+
+/* compress
+   --------
+   Counts the bytes of the block and uses the counts to work out how
+   big the block would be in each mode, then writes the smallest:
+
+   Huffman: Without a shared codebook, the counts are turned into code
+            lengths right here, so the block never has to be read from
+            the file a second time. The lengths of the block's codes go
+            at the start of the payload, followed by the coded bytes.
+   Stored:  The bytes as they are, for data that is already compressed
+            or too random to gain anything from being coded.
+   Runs:    A byte and how many times it repeats for every run, for
+            blocks that are one byte over and over, or nearly so.
+   Context: With contextCodes, order-1 codes from a ContextModel, which
+            are worth their bigger header on text and other data where
+            each byte says a lot about the next.
+   LZ:      With an lzLevel, LZ77 sequences from an LZCoder, which wins
+            by far whenever strings repeat within the block.
+
+   Runs are only counted until they would cost more than the other two,
+   which on ordinary data is almost straight away. Since stored is always
+   an option, the payload is never bigger than the block.
+
+   The clock is only read when there are stats to fill in.
+*/
+
+void BlockCodec::compress(const uint8_t* in, size_t size, vector<uint8_t>& record, Stats* stats) const {
+    chrono::steady_clock::time_point start;
+    if (stats != nullptr) {
+        start = chrono::steady_clock::now();
+    }
+
+    FrequencyMap freqMap(in, size);
+    chrono::steady_clock::time_point counted;
+    if (stats != nullptr) {
+        counted = chrono::steady_clock::now();
+    }
+
+    const Codebook* codebook = sharedCodebook;
+    unique_ptr<Codebook> localCodebook;
+    uint8_t mode = SHARED_HUFFMAN;
+
+    if (codebook == nullptr) {
+        uint8_t lengths[Codebook::NUM_SYMBOLS];
+        Codebook::buildLengths(freqMap, maxCodeLength, lengths);
+        localCodebook.reset(new Codebook(lengths));
+        codebook = localCodebook.get();
+        mode = LOCAL_HUFFMAN;
+    }
+    chrono::steady_clock::time_point built;
+    if (stats != nullptr) {
+        built = chrono::steady_clock::now();
+    }
+
+    /* Pick the smallest mode */
+
+    uint64_t codedBits = 0;
+    for (size_t symbol = 0; symbol < Codebook::NUM_SYMBOLS; symbol++) {
+        codedBits += (uint64_t)freqMap.getFreq(symbol) * codebook->getCode((uint8_t)symbol).nBits;
+    }
+
+    uint8_t lengthsBuffer[Codebook::MAX_LENGTHS_SIZE];
+    size_t huffmanSize = (size_t)(codedBits / 8) + (splitStreams ? 5 * DecodeTable::NUM_STREAMS : 1);
+    if (mode == LOCAL_HUFFMAN) {
+        huffmanSize += codebook->writeLengths(lengthsBuffer);
+    }
+
+    size_t bestSize = min(huffmanSize, size);
+    size_t runsSize = countRuns(in, size, bestSize);
+
+    unique_ptr<ContextModel> contextModel;
+    size_t contextSize = bestSize + 1;
+    if (contextCodes && runsSize > bestSize) {
+        contextModel.reset(new ContextModel(in, size, maxCodeLength));
+        contextSize = contextModel->encodedSize();
+    }
+
+    unique_ptr<LZCoder> lzCoder;
+    size_t lzSize = bestSize + 1;
+    if (lzLevel > 0 && runsSize > bestSize) {
+        lzCoder.reset(new LZCoder(in, size, maxCodeLength, lzLevel));
+        lzSize = lzCoder->encodedSize();
+    }
+
+    if (runsSize < bestSize) {
+        mode = RUNS;
+    }
+    else if (lzSize < bestSize && lzSize <= contextSize) {
+        mode = LZ_HUFFMAN;
+    }
+    else if (contextSize < bestSize) {
+        mode = CONTEXT_HUFFMAN;
+    }
+    else if (size <= huffmanSize) {
+        mode = STORED;
+    }
+
+    /* Write the block */
+
+    size_t maxPayloadSize = max(max(huffmanSize, size), runsSize) + DecodeTable::NUM_STREAMS;
+    record.resize(HEADER_SIZE + maxPayloadSize + 8);
+
+    uint8_t* payload = record.data() + HEADER_SIZE;
+    size_t payloadSize = 0;
+
+    if (mode == STORED) {
+        memcpy(payload, in, size);
+        payloadSize = size;
+    }
+    else if (mode == RUNS) {
+        payloadSize = encodeRuns(in, size, payload);
+    }
+    else if (mode == CONTEXT_HUFFMAN) {
+        payloadSize = contextModel->encode(in, size, payload);
+    }
+    else if (mode == LZ_HUFFMAN) {
+        payloadSize = lzCoder->encode(in, payload);
+    }
+    else {
+        if (mode == LOCAL_HUFFMAN) {
+            payloadSize += codebook->writeLengths(payload);
+        }
+        if (splitStreams) {
+            payloadSize += encodeStreams(*codebook, in, size, payload + payloadSize);
+            mode |= SPLIT_STREAMS;
+        }
+        else {
+            payloadSize += encode(*codebook, in, size, payload + payloadSize);
+        }
+    }
+
+    record[0] = mode;
+    putUInt32(&record[1], (uint32_t)size);
+    putUInt32(&record[5], (uint32_t)payloadSize);
+    record.resize(HEADER_SIZE + payloadSize);
+
+    if (stats != nullptr) {
+        stats->maxCodeLength = 0;
+        for (size_t symbol = 0; symbol < Codebook::NUM_SYMBOLS; symbol++) {
+            stats->counts[symbol] = freqMap.getFreq(symbol);
+            if (stats->counts[symbol] > 0) {
+                stats->maxCodeLength = max(stats->maxCodeLength, codebook->getCode((uint8_t)symbol).nBits);
+            }
+        }
+        stats->codedBits = codedBits;
+        stats->countSeconds = chrono::duration<double>(counted - start).count();
+        stats->buildSeconds = chrono::duration<double>(built - counted).count();
+        stats->codingSeconds = chrono::duration<double>(chrono::steady_clock::now() - built).count();
+    }
+}
+
+
+
+/* Decompression Methods */
+
+/* decompress
+   ----------
+   Checks the header, then copies a stored block, fills in the runs of
+   a run block, hands a context or LZ block to ContextModel or LZCoder,
+   or decodes with the shared table or with a table built from the
+   lengths at the start of the payload.
+*/
+
+bool BlockCodec::decompress(const uint8_t* record, size_t recordSize, uint8_t* out, size_t outSize) const {
+    Header header;
+    if (!readHeader(record, recordSize, header)) {
+        return false;
+    }
+    if (header.uncompressedSize != outSize || HEADER_SIZE + (size_t)header.payloadSize > recordSize) {
+        return false;
+    }
+
+    const uint8_t* payload = record + HEADER_SIZE;
+    size_t payloadSize = header.payloadSize;
+
+    if (header.mode == STORED) {
+        if (payloadSize != outSize) {
+            return false;
+        }
+        memcpy(out, payload, outSize);
+        return true;
+    }
+    else if (header.mode == RUNS) {
+        return decodeRuns(payload, payloadSize, out, outSize);
+    }
+    else if (header.mode == CONTEXT_HUFFMAN) {
+        return ContextModel::decode(payload, payloadSize, out, outSize);
+    }
+    else if (header.mode == LZ_HUFFMAN) {
+        return LZCoder::decode(payload, payloadSize, out, outSize);
+    }
+
+    uint8_t codes = header.mode & ~SPLIT_STREAMS;
+
+    const DecodeTable* table = sharedTable.get();
+    unique_ptr<DecodeTable> localTable;
+
+    if (codes == LOCAL_HUFFMAN) {
+        uint8_t lengths[Codebook::NUM_SYMBOLS];
+        size_t lengthsSize = Codebook::readLengths(payload, payloadSize, lengths);
+        if (lengthsSize == 0) {
+            return false;
+        }
+
+        localTable.reset(new DecodeTable(Codebook(lengths)));
+        table = localTable.get();
+        payload += lengthsSize;
+        payloadSize -= lengthsSize;
+    }
+    else if (codes != SHARED_HUFFMAN || table == nullptr) {
+        return false;
+    }
+
+    if (header.mode & SPLIT_STREAMS) {
+        return decodeStreams(*table, payload, payloadSize, out, outSize);
+    }
+    return decode(*table, payload, payloadSize, out, outSize);
+}
+
+
+/* readHeader
+   ----------
+   The end of blocks marker is a lone mode byte, every other
+   record has the full header.
+*/
+
+bool BlockCodec::readHeader(const uint8_t* in, size_t size, Header& header) {
+    if (size < 1) {
+        return false;
+    }
+    header.mode = in[0];
+    if (header.mode == END_OF_BLOCKS) {
+        header.uncompressedSize = 0;
+        header.payloadSize = 0;
+        return true;
+    }
+    if (size < HEADER_SIZE) {
+        return false;
+    }
+    header.uncompressedSize = getUInt32(&in[1]);
+    header.payloadSize = getUInt32(&in[5]);
+    return true;
+}
+
+
+
+/* encode
+   ------
+   Packs the code for every byte of in with a BitWriter. Returns the
+   number of bytes written, including the padding of the last one.
+   Uses the BMI2 version of the loop if the processor has it.
+*/
+
+size_t BlockCodec::encode(const Codebook& codebook, const uint8_t* in, size_t size, uint8_t* out) {
+    if (CpuFeatures::hasBMI2()) {
+        return encodeBMI2(codebook, in, size, out);
+    }
+    return encodeScalar(codebook, in, size, out);
+}
+
+
+/* decode
+   ------
+   Decodes exactly outSize symbols from the payload. The payload is
+   padded out to a whole byte, but the decoder stops once out is full,
+   so the padding is never read as a symbol.
+*/
+
+bool BlockCodec::decode(const DecodeTable& table, const uint8_t* payload, size_t payloadSize,
+                        uint8_t* out, size_t outSize) {
+    BitReader reader(payload, payloadSize, (uint64_t)payloadSize * 8);
+    return table.decode(reader, out, outSize) == outSize;
+}
+
+
+
+/* Private Methods */
+
+size_t BlockCodec::encodeScalar(const Codebook& codebook, const uint8_t* in, size_t size, uint8_t* out) {
+    return encodeKernel(codebook, in, size, out);
+}
+
+HUFFMAN_TARGET_BMI2 size_t BlockCodec::encodeBMI2(const Codebook& codebook, const uint8_t* in, size_t size, uint8_t* out) {
+    return encodeKernel(codebook, in, size, out);
+}
+
+
+/* encodeKernel
+   ------------
+   Joins the codes of as many bytes as are sure to fit in one write
+   (4 when no code is longer than 14 bits, 3 up to the default limit
+   of 15, and so on), so the writer stores once per group instead of
+   once per byte.
+*/
+
+HUFFMAN_FORCE_INLINE size_t BlockCodec::encodeKernel(const Codebook& codebook, const uint8_t* in, size_t size, uint8_t* out) {
+    BitWriter writer(out);
+    uint32_t maxLength = max(codebook.maxLength(), 1u);
+
+    if (4 * maxLength <= BitWriter::MAX_WRITE_BITS) {
+        encodeGroups(codebook, in, size, writer, 4);
+    }
+    else if (3 * maxLength <= BitWriter::MAX_WRITE_BITS) {
+        encodeGroups(codebook, in, size, writer, 3);
+    }
+    else {
+        encodeGroups(codebook, in, size, writer, 1);
+    }
+
+    writer.finish();
+    return writer.bytesWritten();
+}
+
+
+/* encodeGroups
+   ------------
+   Writes in in groups of groupSize codes, then the bytes left over one
+   at a time. groupSize is always a constant, so once this is inlined
+   the loop over each group is unrolled.
+*/
+
+HUFFMAN_FORCE_INLINE void BlockCodec::encodeGroups(const Codebook& codebook, const uint8_t* in, size_t size,
+                                                   BitWriter& writer, size_t groupSize) {
+    size_t i = 0;
+    for (; i + groupSize <= size; i += groupSize) {
+        uint64_t bits = 0;
+        uint32_t nBits = 0;
+        for (size_t j = 0; j < groupSize; j++) {
+            const Codebook::Code& code = codebook.getCode(in[i + j]);
+            bits = (bits << code.nBits) | code.bits;
+            nBits += code.nBits;
+        }
+        writer.write(bits, nBits);
+    }
+    for (; i < size; i++) {
+        const Codebook::Code& code = codebook.getCode(in[i]);
+        writer.write(code.bits, code.nBits);
+    }
+}
+
+
+/* encodeStreams
+   -------------
+   Splits the block into NUM_STREAMS parts of the same size (the last
+   may be shorter) and codes each into its own stream. The sizes of all
+   but the last stream go first, so the decoder can find where each
+   one starts:
+
+   ---------------------------------------------------------------------
+   |                      |              |              |       |       |
+   |  Stream Sizes        |  Stream 1    |  Stream 2    |  ...  |  Last |
+   |  (4B each, not last) |  (Any)       |  (Any)       |       |  (Any)|
+   ---------------------------------------------------------------------
+*/
+
+size_t BlockCodec::encodeStreams(const Codebook& codebook, const uint8_t* in, size_t size, uint8_t* out) {
+    const size_t nStreams = DecodeTable::NUM_STREAMS;
+    size_t partSize = (size + nStreams - 1) / nStreams;
+    size_t written = 4 * (nStreams - 1);
+
+    for (size_t i = 0; i < nStreams; i++) {
+        size_t first = min(i * partSize, size);
+        size_t last = min(first + partSize, size);
+        size_t streamSize = encode(codebook, in + first, last - first, out + written);
+        if (i < nStreams - 1) {
+            putUInt32(out + 4 * i, (uint32_t)streamSize);
+        }
+        written += streamSize;
+    }
+    return written;
+}
+
+
+/* countRuns
+   ---------
+   Returns how big the block would be as runs, or limit + 1 as soon as
+   it is clear the runs would be bigger than limit.
+*/
+
+size_t BlockCodec::countRuns(const uint8_t* in, size_t size, size_t limit) {
+    size_t runsSize = 0;
+    size_t i = 0;
+    while (i < size) {
+        size_t runStart = i;
+        while (i < size && in[i] == in[runStart]) {
+            i++;
+        }
+        runsSize += 1 + varUIntSize(i - runStart);
+        if (runsSize > limit) {
+            return limit + 1;
+        }
+    }
+    return runsSize;
+}
+
+
+/* encodeRuns
+   ----------
+   Writes every run as its byte followed by its length:
+
+   ------------------------------------------------------
+   |        |                        |        |         |
+   |  Byte  |  Run Length            |  Byte  |  ...    |
+   |  (1B)  |  (1-5B, 7 bits each)   |  (1B)  |         |
+   ------------------------------------------------------
+*/
+
+size_t BlockCodec::encodeRuns(const uint8_t* in, size_t size, uint8_t* out) {
+    size_t written = 0;
+    size_t i = 0;
+    while (i < size) {
+        size_t runStart = i;
+        while (i < size && in[i] == in[runStart]) {
+            i++;
+        }
+        out[written++] = in[runStart];
+        written += putVarUInt(out + written, (uint32_t)(i - runStart));
+    }
+    return written;
+}
+
+
+/* decodeStreams
+   -------------
+   Finds where every stream starts from the sizes in front of them and
+   which part of out each one fills, then decodes them all together.
+*/
+
+bool BlockCodec::decodeStreams(const DecodeTable& table, const uint8_t* payload, size_t payloadSize,
+                               uint8_t* out, size_t outSize) {
+    const size_t nStreams = DecodeTable::NUM_STREAMS;
+    size_t offset = 4 * (nStreams - 1);
+    if (payloadSize < offset) {
+        return false;
+    }
+
+    size_t partSize = (outSize + nStreams - 1) / nStreams;
+    BitReader readers[nStreams];
+    uint8_t* parts[nStreams];
+    size_t partSizes[nStreams];
+
+    for (size_t i = 0; i < nStreams; i++) {
+        size_t streamSize = (i < nStreams - 1) ? getUInt32(payload + 4 * i) : payloadSize - offset;
+        if (streamSize > payloadSize - offset) {
+            return false;
+        }
+        readers[i] = BitReader(payload + offset, streamSize, (uint64_t)streamSize * 8);
+        offset += streamSize;
+
+        size_t first = min(i * partSize, outSize);
+        parts[i] = out + first;
+        partSizes[i] = min(first + partSize, outSize) - first;
+    }
+
+    return table.decodeStreams(readers, parts, partSizes);
+}
+
+
+/* decodeRuns
+   ----------
+   Fills out with each run in turn. Returns false if the runs do not
+   add up to exactly outSize bytes.
+*/
+
+bool BlockCodec::decodeRuns(const uint8_t* payload, size_t payloadSize, uint8_t* out, size_t outSize) {
+    size_t read = 0;
+    size_t written = 0;
+    while (read < payloadSize) {
+        uint8_t byte = payload[read++];
+        uint32_t runLength;
+        size_t lengthSize = getVarUInt(payload + read, payloadSize - read, runLength);
+        if (lengthSize == 0 || runLength > outSize - written) {
+            return false;
+        }
+        read += lengthSize;
+
+        memset(out + written, byte, runLength);
+        written += runLength;
+    }
+    return written == outSize;
+}
\ No newline at end of file
@@ -0,0 +1,292 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "BitWriter.h"
+#include "Codebook.h"
+#include "DecodeTable.h"
+
+using namespace std;
+
+
+
+/* BlockCodec
+   ----------
+   Compresses and decompresses one block of a file entirely in memory.
+   Blocks do not depend on each other, so any number of them can be
+   worked on at the same time, each by a different thread.
+
+   A codec made with a codebook codes every block with it. Otherwise
+   each block gets its own codes built from its own bytes, none longer
+   than maxCodeLength, which are stored at the start of its payload.
+
+   A block can also be split into DecodeTable::NUM_STREAMS parts that
+   are coded into separate streams, so they can be decoded side by side.
+
+   Blocks that Huffman codes would not make smaller are stored as they
+   are, and blocks made of long runs of the same byte are stored as runs.
+   With contextCodes, blocks can also be coded with a ContextModel if
+   that comes out smaller, at the cost of some extra time. Likewise with
+   an lzLevel above 0, an LZCoder of that level is tried on every block.
+
+   Every compressed block is a record that starts with a small header,
+   so the records can be read back one after another:
+
+   ------------------------------------------------------------------
+   |            |                     |                |            |
+   |    Mode    |  Uncompressed Size  |  Payload Size  |  Payload   |
+   |    (1B)    |        (4B)         |      (4B)      |  (Any)     |
+   ------------------------------------------------------------------
+*/
+
+
+
+class BlockCodec {
+public:
+
+    /* Block Modes */
+
+    static const uint8_t SHARED_HUFFMAN = 0;   //coded with the file's codebook
+    static const uint8_t LOCAL_HUFFMAN = 1;    //coded with the block's own code lengths, stored first
+    static const uint8_t STORED = 2;           //the bytes as they are
+    static const uint8_t RUNS = 3;             //(byte, run length) for every run of the same byte
+    static const uint8_t CONTEXT_HUFFMAN = 4;  //coded with order-1 tables, chosen by the byte before
+    static const uint8_t LZ_HUFFMAN = 5;       //LZ77 sequences, coded with their own tables
+    static const uint8_t END_OF_BLOCKS = 0xFF; //marks the end of the records, has no sizes
+
+    static const uint8_t SPLIT_STREAMS = 0x10; //or'ed into a Huffman mode when coded as several streams
+
+
+    /* Constants */
+
+    static const size_t HEADER_SIZE = 9;
+
+
+    /* Header
+       ------
+       The header at the start of every block record.
+    */
+
+    struct Header {
+        uint8_t mode = END_OF_BLOCKS;
+        uint32_t uncompressedSize = 0;
+        uint32_t payloadSize = 0;
+    };
+
+
+    /* Stats
+       -----
+       What compress found out about one block along the way: the count
+       of every byte, how many bits its Huffman codes would take and the
+       longest of them, and how long counting, building the codes and
+       coding took.
+    */
+
+    struct Stats {
+        uint64_t counts[Codebook::NUM_SYMBOLS] = {};
+        uint64_t codedBits = 0;
+        uint32_t maxCodeLength = 0;
+        double countSeconds = 0;
+        double buildSeconds = 0;
+        double codingSeconds = 0;
+    };
+
+
+    /* Constructors */
+
+    BlockCodec(uint32_t maxCodeLength = Codebook::MAX_CODE_LENGTH, bool splitStreams = false,
+               bool contextCodes = false, uint32_t lzLevel = 0);
+
+    BlockCodec(const Codebook& sharedCodebook, bool splitStreams = false, bool contextCodes = false,
+               uint32_t lzLevel = 0);
+
+
+    /* Public Interface */
+
+
+    /* compress
+       --------
+       Compresses size bytes from in into a complete block record,
+       replacing whatever was in record. Fills in stats if given.
+    */
+
+    void compress(const uint8_t* in, size_t size, vector<uint8_t>& record, Stats* stats = nullptr) const;
+
+
+    /* decompress
+       ----------
+       Decompresses a block record into out, which must be exactly the
+       block's uncompressed size. Returns false if the record is corrupt.
+    */
+
+    bool decompress(const uint8_t* record, size_t recordSize, uint8_t* out, size_t outSize) const;
+
+
+    /* maxPayloadSize
+       --------------
+       The biggest payload a block of size bytes can compress to. A mode
+       that would make the payload bigger than the block is never picked.
+    */
+
+    static inline size_t maxPayloadSize(size_t size);
+
+
+    /* readHeader
+       ----------
+       Parses the header at the start of a record. Returns false if
+       there are not enough bytes for it.
+    */
+
+    static bool readHeader(const uint8_t* in, size_t size, Header& header);
+
+
+    /* Little Endian Integers */
+
+    static inline void putUInt32(uint8_t* out, uint32_t value);
+
+    static inline void putUInt64(uint8_t* out, uint64_t value);
+
+    static inline uint32_t getUInt32(const uint8_t* in);
+
+    static inline uint64_t getUInt64(const uint8_t* in);
+
+
+    /* Variable Length Integers, 7 bits per byte, least significant first */
+
+    static inline size_t putVarUInt(uint8_t* out, uint32_t value);
+
+    static inline size_t getVarUInt(const uint8_t* in, size_t size, uint32_t& value);
+
+    static inline size_t varUIntSize(uint64_t value);
+
+
+    /* encode
+       ------
+       Codes size bytes with codebook alone, with nothing else around
+       them, and returns how many bytes that took. out must have room for
+       the coded bits plus 8 bytes of slack.
+    */
+
+    static size_t encode(const Codebook& codebook, const uint8_t* in, size_t size, uint8_t* out);
+
+
+    /* decode
+       ------
+       Decodes exactly outSize bytes coded by encode. Returns false if the
+       payload runs out first.
+    */
+
+    static bool decode(const DecodeTable& table, const uint8_t* payload, size_t payloadSize,
+                       uint8_t* out, size_t outSize);
+
+
+private:
+
+    /* Private Variables */
+
+    uint32_t maxCodeLength = Codebook::MAX_CODE_LENGTH;
+    bool splitStreams = false;
+    bool contextCodes = false;
+    uint32_t lzLevel = 0;
+    const Codebook* sharedCodebook = nullptr;
+    unique_ptr<DecodeTable> sharedTable;
+
+
+    /* Private Methods */
+
+    static size_t encodeScalar(const Codebook& codebook, const uint8_t* in, size_t size, uint8_t* out);
+
+    static size_t encodeBMI2(const Codebook& codebook, const uint8_t* in, size_t size, uint8_t* out);
+
+    static inline size_t encodeKernel(const Codebook& codebook, const uint8_t* in, size_t size, uint8_t* out);
+
+    static inline void encodeGroups(const Codebook& codebook, const uint8_t* in, size_t size,
+                                    BitWriter& writer, size_t groupSize);
+
+    static size_t encodeStreams(const Codebook& codebook, const uint8_t* in, size_t size, uint8_t* out);
+
+    static size_t countRuns(const uint8_t* in, size_t size, size_t limit);
+
+    static size_t encodeRuns(const uint8_t* in, size_t size, uint8_t* out);
+
+    static bool decodeStreams(const DecodeTable& table, const uint8_t* payload, size_t payloadSize,
+                              uint8_t* out, size_t outSize);
+
+    static bool decodeRuns(const uint8_t* payload, size_t payloadSize, uint8_t* out, size_t outSize);
+
+};
+
+
+
+/* Inline Methods */
+
+inline size_t BlockCodec::maxPayloadSize(size_t size) {
+    return size;
+}
+
+inline void BlockCodec::putUInt32(uint8_t* out, uint32_t value) {
+    for (size_t i = 0; i < 4; i++) {
+        out[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+inline void BlockCodec::putUInt64(uint8_t* out, uint64_t value) {
+    for (size_t i = 0; i < 8; i++) {
+        out[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+inline uint32_t BlockCodec::getUInt32(const uint8_t* in) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < 4; i++) {
+        value |= (uint32_t)in[i] << (i * 8);
+    }
+    return value;
+}
+
+inline uint64_t BlockCodec::getUInt64(const uint8_t* in) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < 8; i++) {
+        value |= (uint64_t)in[i] << (i * 8);
+    }
+    return value;
+}
+
+/* putVarUInt writes value and returns how many bytes it took. getVarUInt
+   returns how many bytes it read, or 0 if the value runs past size or
+   does not fit in 32 bits. */
+
+inline size_t BlockCodec::putVarUInt(uint8_t* out, uint32_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+inline size_t BlockCodec::getVarUInt(const uint8_t* in, size_t size, uint32_t& value) {
+    uint64_t result = 0;
+    for (size_t n = 0; n < size && n < 5; n++) {
+        result |= (uint64_t)(in[n] & 0x7F) << (n * 7);
+        if ((in[n] & 0x80) == 0) {
+            if (result > 0xFFFFFFFFull) {
+                return 0;
+            }
+            value = (uint32_t)result;
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+inline size_t BlockCodec::varUIntSize(uint64_t value) {
+    size_t n = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        n++;
+    }
+    return n;
+}
\ No newline at end of file
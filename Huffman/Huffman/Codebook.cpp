@@ -0,0 +1,348 @@
+#include <algorithm>
+#include <vector>
+
+#include "Codebook.h"
+
+
+
+/* Codebook
+   --------
+   Maps each byte to its bit representation in a single
+   table that is filled in one walk of the tree.
+*/
+
+
+
+/* Constants */
+
+constexpr uint32_t Codebook::MAX_CODE_LENGTH;
+constexpr uint32_t Codebook::MIN_LENGTH_LIMIT;
+
+
+
+/* Constructors */
+
+/* Copies the codes straight out of the tree */
+
+Codebook::Codebook(const Tree& tree) {
+    collectCodes(tree.root, 0, 0);
+}
+
+/* Assigns canonical codes to the given code lengths */
+
+Codebook::Codebook(const uint8_t lengths[NUM_SYMBOLS]) {
+    assignCanonicalCodes(lengths);
+}
+
+
+
+/* Public Interface */
+
+/* maxLength
+   ---------
+   Returns the length in bits of the longest code, which bounds
+   how much output a single input byte can produce.
+*/
+
+uint32_t Codebook::maxLength() const {
+    uint32_t longest = 0;
+    for (size_t symbol = 0; symbol < NUM_SYMBOLS; symbol++) {
+        longest = max(longest, codes[symbol].nBits);
+    }
+    return longest;
+}
+
+
+
+/* writeLengths
+   ------------
+   Stores the lengths whichever of two ways is smaller:
+
+   Dense:  The length of every symbol up to the highest one that has a
+           code. When every length fits in 4 bits (which is almost always),
+           two lengths are packed into each byte, high nibble first.
+
+   Sparse: A (symbol, length) pair for each symbol that has a code, which
+           wins when only a handful of bytes appear in the file.
+
+   --------------------------------------------------------------------
+   |                        |               |                         |
+   |  Bits Per Length       |  # Items - 1  |  Lengths / Pairs        |
+   |  (1B, 4/8, 0=sparse)   |     (1B)      |  (<=256B)               |
+   --------------------------------------------------------------------
+*/
+
+size_t Codebook::writeLengths(uint8_t* out) const {
+    size_t nDense = NUM_SYMBOLS;
+    while (nDense > 1 && codes[nDense - 1].nBits == 0) {
+        nDense--;
+    }
+
+    size_t nSparse = 0;
+    for (size_t symbol = 0; symbol < NUM_SYMBOLS; symbol++) {
+        nSparse += (codes[symbol].nBits > 0) ? 1 : 0;
+    }
+
+    uint8_t bitsPerLength = (maxLength() < 16) ? 4 : 8;
+    size_t denseSize = (bitsPerLength == 4) ? (nDense + 1) / 2 : nDense;
+    size_t size = 2;
+
+    if (nSparse * 2 < denseSize) {
+        out[0] = SPARSE_LENGTHS;
+        out[1] = (uint8_t)(nSparse - 1);
+        for (size_t symbol = 0; symbol < NUM_SYMBOLS; symbol++) {
+            if (codes[symbol].nBits > 0) {
+                out[size++] = (uint8_t)symbol;
+                out[size++] = (uint8_t)codes[symbol].nBits;
+            }
+        }
+    }
+    else {
+        out[0] = bitsPerLength;
+        out[1] = (uint8_t)(nDense - 1);
+        for (size_t symbol = 0; symbol < nDense; symbol++) {
+            if (bitsPerLength == 8) {
+                out[size++] = (uint8_t)codes[symbol].nBits;
+            }
+            else if (symbol % 2 == 0) {
+                out[size++] = (uint8_t)(codes[symbol].nBits << 4);
+            }
+            else {
+                out[size - 1] |= (uint8_t)codes[symbol].nBits;
+            }
+        }
+    }
+    return size;
+}
+
+
+/* readLengths
+   -----------
+   Unpacks the lengths, then checks that they could really have come
+   from a binary tree: no length is too long for a Code, at least one
+   symbol has a code, and the codes do not need more room than the
+   tree has (the Kraft inequality).
+*/
+
+size_t Codebook::readLengths(const uint8_t* in, size_t size, uint8_t lengths[NUM_SYMBOLS]) {
+    if (size < 2) {
+        return 0;
+    }
+
+    uint8_t bitsPerLength = in[0];
+    size_t nItems = (size_t)in[1] + 1;
+    size_t totalSize = lengthsSize(in);
+    if (totalSize == 0 || size < totalSize) {
+        return 0;
+    }
+
+    fill(lengths, lengths + NUM_SYMBOLS, (uint8_t)0);
+    for (size_t i = 0; i < nItems; i++) {
+        if (bitsPerLength == SPARSE_LENGTHS) {
+            lengths[in[2 + i * 2]] = in[3 + i * 2];
+        }
+        else if (bitsPerLength == 4) {
+            uint8_t packed = in[2 + i / 2];
+            lengths[i] = (i % 2 == 0) ? (packed >> 4) : (packed & 0xF);
+        }
+        else {
+            lengths[i] = in[2 + i];
+        }
+    }
+
+    uint64_t kraftSum = 0;
+    for (size_t symbol = 0; symbol < NUM_SYMBOLS; symbol++) {
+        if (lengths[symbol] > MAX_CODE_LENGTH) {
+            return 0;
+        }
+        if (lengths[symbol] > 0) {
+            kraftSum += (uint64_t)1 << (MAX_CODE_LENGTH - lengths[symbol]);
+        }
+    }
+    if (kraftSum == 0 || kraftSum > ((uint64_t)1 << MAX_CODE_LENGTH)) {
+        return 0;
+    }
+
+    return totalSize;
+}
+
+
+/* lengthsSize
+   -----------
+   The first byte says how the lengths are packed and the second how
+   many of them there are, which is all it takes to know the size.
+   writeLengths only picks sparse pairs when they are smaller than the
+   dense lengths, so more than MAX_SPARSE_ITEMS of them is not valid.
+*/
+
+size_t Codebook::lengthsSize(const uint8_t* in) {
+    size_t nItems = (size_t)in[1] + 1;
+
+    if (in[0] == SPARSE_LENGTHS) {
+        return (nItems <= MAX_SPARSE_ITEMS) ? 2 + nItems * 2 : 0;
+    }
+    else if (in[0] == 4) {
+        return 2 + (nItems + 1) / 2;
+    }
+    else if (in[0] == 8) {
+        return 2 + nItems;
+    }
+    return 0;
+}
+
+
+
+/* buildLengths
+   ------------
+   Builds the binary tree and takes the depth of each leaf, which
+   gives the best possible lengths. Very skewed frequencies can make
+   the tree deeper than maxLength though, and only then are the
+   lengths worked out again with package-merge, which finds the best
+   lengths that stay within the limit.
+*/
+
+void Codebook::buildLengths(const FrequencyMap& freqMap, uint32_t maxLength, uint8_t lengths[NUM_SYMBOLS]) {
+    maxLength = min(max(maxLength, MIN_LENGTH_LIMIT), MAX_CODE_LENGTH);
+
+    Tree freqTree(freqMap);
+    freqTree.getCodeLengths(lengths);
+
+    if (*max_element(lengths, lengths + NUM_SYMBOLS) > maxLength) {
+        packageMerge(freqMap, maxLength, lengths);
+    }
+}
+
+
+
+/* Private Methods */
+
+/* collectCodes
+   ------------
+   Walks the tree once, adding a 0 to the bits when going left and
+   a 1 when going right, and stores them when we reach a leaf.
+
+   If the root is a leaf there is only one possible byte in the
+   file, so like findBitRepOf it gets the bits 1 with a length of 1.
+*/
+
+void Codebook::collectCodes(const Node* node, uint32_t bits, uint32_t nBits) {
+    if (node->isLeaf) {
+        Code& code = codes[node->byte];
+        code.bits = (nBits == 0) ? 1 : bits;
+        code.nBits = (nBits == 0) ? 1 : nBits;
+    }
+    else {
+        collectCodes(node->left, bits << 1, nBits + 1);
+        collectCodes(node->right, (bits << 1) + 1, nBits + 1);
+    }
+}
+
+
+/* assignCanonicalCodes
+   --------------------
+   Gives out codes in order of length, and within a length in order
+   of symbol, counting up by one each time and adding a 0 to the end
+   whenever the length grows. Any set of lengths that came from a
+   binary tree gets a valid set of codes this way, with no tree needed.
+*/
+
+void Codebook::assignCanonicalCodes(const uint8_t lengths[NUM_SYMBOLS]) {
+    uint32_t lengthCounts[MAX_CODE_LENGTH + 1] = { 0 };
+    for (size_t symbol = 0; symbol < NUM_SYMBOLS; symbol++) {
+        if (lengths[symbol] > 0) {
+            lengthCounts[lengths[symbol]]++;
+        }
+    }
+
+    uint64_t nextCode[MAX_CODE_LENGTH + 1] = { 0 };
+    uint64_t code = 0;
+    for (uint32_t length = 1; length <= MAX_CODE_LENGTH; length++) {
+        code = (code + lengthCounts[length - 1]) << 1;
+        nextCode[length] = code;
+    }
+
+    for (size_t symbol = 0; symbol < NUM_SYMBOLS; symbol++) {
+        uint8_t length = lengths[symbol];
+        codes[symbol].nBits = length;
+        codes[symbol].bits = (length > 0) ? (uint32_t)nextCode[length]++ : 0;
+    }
+}
+
+
+/* packageMerge
+   ------------
+   Finds the lengths, none longer than maxLength, that give the
+   smallest output for these frequencies. Every item is either a
+   single symbol or a package of two items from the list below it:
+
+   1. The bottom list is every symbol that appears, sorted by frequency
+   2. Each list above it pairs up the list below into packages, in order,
+        and merges those with the symbols again, keeping it sorted
+   3. After maxLength lists, the cheapest 2n - 2 items of the top list are
+        taken, and every time a symbol shows up inside one of them (directly
+        or in a package, however deep) its length goes up by one
+
+   Packages are made from the list below in order and stay in that order
+   once merged, so taking the first m packages of a list means taking the
+   first 2m items of the list below. This lets step 3 walk down the lists
+   one at a time without remembering what is inside each package.
+*/
+
+void Codebook::packageMerge(const FrequencyMap& freqMap, uint32_t maxLength, uint8_t lengths[NUM_SYMBOLS]) {
+    struct Item {
+        uint64_t weight;
+        int32_t symbol; //-1 for a package
+    };
+
+    vector<Item> symbols;
+    for (size_t symbol = 0; symbol < NUM_SYMBOLS; symbol++) {
+        if (freqMap.getFreq(symbol) > 0) {
+            symbols.push_back({ freqMap.getFreq(symbol), (int32_t)symbol });
+        }
+    }
+    stable_sort(symbols.begin(), symbols.end(), [](const Item& a, const Item& b) {
+        return a.weight < b.weight;
+    });
+
+    vector<vector<Item>> lists(maxLength);
+    lists[0] = symbols;
+
+    for (uint32_t level = 1; level < maxLength; level++) {
+        const vector<Item>& below = lists[level - 1];
+        vector<Item>& list = lists[level];
+
+        size_t nextSymbol = 0;
+        size_t nextPair = 0;
+        size_t nPairs = below.size() / 2;
+
+        while (nextSymbol < symbols.size() || nextPair < nPairs) {
+            uint64_t pairWeight = (nextPair < nPairs)
+                ? below[nextPair * 2].weight + below[nextPair * 2 + 1].weight : 0;
+
+            if (nextPair == nPairs || (nextSymbol < symbols.size() && symbols[nextSymbol].weight <= pairWeight)) {
+                list.push_back(symbols[nextSymbol++]);
+            }
+            else {
+                list.push_back({ pairWeight, -1 });
+                nextPair++;
+            }
+        }
+    }
+
+    fill(lengths, lengths + NUM_SYMBOLS, (uint8_t)0);
+
+    size_t nTaken = symbols.size() * 2 - 2;
+    for (uint32_t level = maxLength; level-- > 0;) {
+        size_t nPackages = 0;
+        for (size_t i = 0; i < nTaken; i++) {
+            const Item& item = lists[level][i];
+            if (item.symbol >= 0) {
+                lengths[item.symbol]++;
+            }
+            else {
+                nPackages++;
+            }
+        }
+        nTaken = nPackages * 2;
+    }
+}
\ No newline at end of file
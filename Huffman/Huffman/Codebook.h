@@ -0,0 +1,139 @@
+#pragma once
+#include <cstdint>
+
+#include "Tree.h"
+
+using namespace std;
+
+
+
+/* Codebook
+   --------
+   The bit representation of every possible byte, found once
+   so that the compressor can look each byte up directly instead
+   of searching the tree for it.
+
+   A codebook can either copy the codes straight out of a tree,
+   or assign canonical codes from nothing but the code lengths.
+   Canonical codes can be rebuilt by the decompressor from the
+   lengths alone, so those are all that need to be stored.
+
+   Code lengths for the compressor come from buildLengths, which
+   keeps every code within a chosen maximum length.
+*/
+
+
+
+class Codebook {
+public:
+
+    /* Constants */
+
+    static const size_t NUM_SYMBOLS = 256;
+    static constexpr uint32_t MAX_CODE_LENGTH = 32;
+    static constexpr uint32_t MIN_LENGTH_LIMIT = 8;   //the shortest limit that still fits all 256 symbols
+    static const size_t MAX_LENGTHS_SIZE = 2 + NUM_SYMBOLS;
+    static const uint8_t SPARSE_LENGTHS = 0;
+    static const size_t MAX_SPARSE_ITEMS = (MAX_LENGTHS_SIZE - 2) / 2;   //so sparse pairs never take more room than dense lengths
+
+
+    /* Code
+       ----
+       The bits of a symbol's representation, right aligned, and
+       how many of them there are. A length of 0 means the symbol
+       does not appear in the tree.
+    */
+
+    struct Code {
+        uint32_t bits = 0;
+        uint32_t nBits = 0;
+    };
+
+
+    /* Constructors */
+
+    Codebook(const Tree& tree);
+
+    Codebook(const uint8_t lengths[NUM_SYMBOLS]);
+
+
+    /* Public Interface */
+
+
+    /* getCode
+       -------
+       Returns the code for a byte.
+    */
+
+    inline const Code& getCode(uint8_t symbol) const;
+
+
+    /* maxLength
+       ---------
+       Returns the length in bits of the longest code.
+    */
+
+    uint32_t maxLength() const;
+
+
+    /* writeLengths
+       ------------
+       Packs the code length of every symbol into out, which must have
+       room for MAX_LENGTHS_SIZE bytes. Returns the number of bytes used.
+    */
+
+    size_t writeLengths(uint8_t* out) const;
+
+
+    /* readLengths
+       -----------
+       Unpacks code lengths written by writeLengths. Returns the number
+       of bytes read, or 0 if they do not describe a valid code.
+    */
+
+    static size_t readLengths(const uint8_t* in, size_t size, uint8_t lengths[NUM_SYMBOLS]);
+
+
+    /* lengthsSize
+       -----------
+       Returns how many bytes packed lengths take up in total, from just
+       their first 2 bytes, or 0 if those are not valid. Valid lengths
+       never take up more than MAX_LENGTHS_SIZE bytes.
+    */
+
+    static size_t lengthsSize(const uint8_t* in);
+
+
+    /* buildLengths
+       ------------
+       Finds the code length of every byte in freqMap, with no code
+       longer than maxLength bits (MIN_LENGTH_LIMIT to MAX_CODE_LENGTH).
+    */
+
+    static void buildLengths(const FrequencyMap& freqMap, uint32_t maxLength, uint8_t lengths[NUM_SYMBOLS]);
+
+
+private:
+
+    /* Private Variables */
+
+    Code codes[NUM_SYMBOLS];
+
+
+    /* Private Methods */
+
+    void collectCodes(const Node* node, uint32_t bits, uint32_t nBits);
+
+    void assignCanonicalCodes(const uint8_t lengths[NUM_SYMBOLS]);
+
+    static void packageMerge(const FrequencyMap& freqMap, uint32_t maxLength, uint8_t lengths[NUM_SYMBOLS]);
+
+};
+
+
+
+/* Inline Methods */
+
+inline const Codebook::Code& Codebook::getCode(uint8_t symbol) const {
+    return codes[symbol];
+}
\ No newline at end of file
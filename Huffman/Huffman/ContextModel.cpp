@@ -0,0 +1,211 @@
+#include <cstring>
+
+#include "BitReader.h"
+#include "BitWriter.h"
+#include "ContextModel.h"
+#include "DecodeTable.h"
+#include "FrequencyMap.h"
+
+
+
+/* ContextModel
+   ------------
+   Order-1 codes for a block, with a table for every context that
+   earns one and a fallback table for the rest.
+*/
+
+
+
+/* Constructor */
+
+/* Counts every pair of neighbouring bytes, then gives a context its own
+   table only if coding its bytes with it, plus the table's lengths, is
+   smaller than coding them with the codes of the whole block. The
+   fallback table is then built from the contexts that are left, which
+   fits them better than the codes of the whole block did. */
+
+ContextModel::ContextModel(const uint8_t* in, size_t size, uint32_t maxCodeLength) {
+    vector<uint64_t> counts(NUM_CONTEXTS * Codebook::NUM_SYMBOLS);
+    countPairs(in, size, counts);
+
+    uint64_t blockCounts[Codebook::NUM_SYMBOLS] = { 0 };
+    for (size_t context = 0; context < NUM_CONTEXTS; context++) {
+        for (size_t symbol = 0; symbol < Codebook::NUM_SYMBOLS; symbol++) {
+            blockCounts[symbol] += counts[context * Codebook::NUM_SYMBOLS + symbol];
+        }
+    }
+
+    uint8_t lengths[Codebook::NUM_SYMBOLS];
+    uint8_t lengthsBuffer[Codebook::MAX_LENGTHS_SIZE];
+    Codebook::buildLengths(FrequencyMap(blockCounts), maxCodeLength, lengths);
+    Codebook blockCodebook(lengths);
+
+    /* Pick the contexts that get their own table */
+
+    vector<Codebook> ownTables;
+    uint64_t fallbackCounts[Codebook::NUM_SYMBOLS] = { 0 };
+    bool anyFallback = false;
+
+    for (size_t context = 0; context < NUM_CONTEXTS; context++) {
+        const uint64_t* contextCounts = &counts[context * Codebook::NUM_SYMBOLS];
+        tableOf[context] = 0;
+
+        uint64_t blockBits = codedBits(contextCounts, blockCodebook);
+        if (blockBits == 0) {
+            continue;
+        }
+
+        Codebook::buildLengths(FrequencyMap(contextCounts), maxCodeLength, lengths);
+        Codebook ownCodebook(lengths);
+        uint64_t ownBits = codedBits(contextCounts, ownCodebook) + 8 * ownCodebook.writeLengths(lengthsBuffer);
+
+        if (ownBits < blockBits) {
+            ownTables.push_back(ownCodebook);
+            tableOf[context] = (uint16_t)ownTables.size();
+        }
+        else {
+            for (size_t symbol = 0; symbol < Codebook::NUM_SYMBOLS; symbol++) {
+                fallbackCounts[symbol] += contextCounts[symbol];
+            }
+            anyFallback = true;
+        }
+    }
+
+    /* The fallback table needs at least one code to be valid, even if no
+       context ends up using it */
+
+    Codebook::buildLengths(FrequencyMap(anyFallback ? fallbackCounts : blockCounts), maxCodeLength, lengths);
+    tables.push_back(Codebook(lengths));
+    tables.insert(tables.end(), ownTables.begin(), ownTables.end());
+
+    /* Work out the exact size of the payload */
+
+    uint64_t totalBits = 0;
+    for (size_t context = 0; context < NUM_CONTEXTS; context++) {
+        totalBits += codedBits(&counts[context * Codebook::NUM_SYMBOLS], tables[tableOf[context]]);
+    }
+
+    payloadSize = OWN_TABLES_SIZE + (size_t)((totalBits + 7) / 8);
+    for (const Codebook& table : tables) {
+        payloadSize += table.writeLengths(lengthsBuffer);
+    }
+}
+
+
+
+/* Public Interface */
+
+size_t ContextModel::encodedSize() const {
+    return payloadSize;
+}
+
+
+/* encode
+   ------
+   Writes the header, then codes every byte with the table of the
+   byte before it.
+*/
+
+size_t ContextModel::encode(const uint8_t* in, size_t size, uint8_t* out) const {
+    memset(out, 0, OWN_TABLES_SIZE);
+    for (size_t context = 0; context < NUM_CONTEXTS; context++) {
+        if (tableOf[context] != 0) {
+            out[context / 8] |= (uint8_t)(0x80 >> (context % 8));
+        }
+    }
+
+    size_t written = OWN_TABLES_SIZE;
+    for (const Codebook& table : tables) {
+        written += table.writeLengths(out + written);
+    }
+
+    const Codebook* tableFor[NUM_CONTEXTS];
+    for (size_t context = 0; context < NUM_CONTEXTS; context++) {
+        tableFor[context] = &tables[tableOf[context]];
+    }
+
+    BitWriter writer(out + written);
+    uint8_t previous = 0;
+    for (size_t i = 0; i < size; i++) {
+        const Codebook::Code& code = tableFor[previous]->getCode(in[i]);
+        writer.write(code.bits, code.nBits);
+        previous = in[i];
+    }
+    writer.finish();
+    return written + writer.bytesWritten();
+}
+
+
+/* decode
+   ------
+   Reads which contexts have their own table, builds a DecodeTable for
+   the fallback and for each of them, and hands them all to the context
+   decoder along with the coded bytes.
+*/
+
+bool ContextModel::decode(const uint8_t* payload, size_t payloadSize, uint8_t* out, size_t outSize) {
+    if (payloadSize < OWN_TABLES_SIZE) {
+        return false;
+    }
+
+    size_t nOwnTables = 0;
+    for (size_t context = 0; context < NUM_CONTEXTS; context++) {
+        nOwnTables += (payload[context / 8] >> (7 - context % 8)) & 1;
+    }
+
+    vector<DecodeTable> decodeTables;
+    decodeTables.reserve(1 + nOwnTables);
+    size_t read = OWN_TABLES_SIZE;
+    uint8_t lengths[Codebook::NUM_SYMBOLS];
+
+    for (size_t i = 0; i < 1 + nOwnTables; i++) {
+        size_t lengthsSize = Codebook::readLengths(payload + read, payloadSize - read, lengths);
+        if (lengthsSize == 0) {
+            return false;
+        }
+        decodeTables.emplace_back(Codebook(lengths));
+        read += lengthsSize;
+    }
+
+    const DecodeTable* tableFor[NUM_CONTEXTS];
+    size_t nextTable = 1;
+    for (size_t context = 0; context < NUM_CONTEXTS; context++) {
+        bool ownTable = (payload[context / 8] >> (7 - context % 8)) & 1;
+        tableFor[context] = &decodeTables[ownTable ? nextTable++ : 0];
+    }
+
+    BitReader reader(payload + read, payloadSize - read, (uint64_t)(payloadSize - read) * 8);
+    return DecodeTable::decodeContexts(tableFor, reader, out, outSize) == outSize;
+}
+
+
+
+/* Private Methods */
+
+/* countPairs
+   ----------
+   Counts how often each byte follows each other byte, with the first
+   byte following a 0. counts is indexed by context * 256 + byte.
+*/
+
+void ContextModel::countPairs(const uint8_t* in, size_t size, vector<uint64_t>& counts) {
+    uint8_t previous = 0;
+    for (size_t i = 0; i < size; i++) {
+        counts[(size_t)previous * Codebook::NUM_SYMBOLS + in[i]]++;
+        previous = in[i];
+    }
+}
+
+
+/* codedBits
+   ---------
+   Returns how many bits bytes with these counts take with codebook.
+*/
+
+uint64_t ContextModel::codedBits(const uint64_t counts[Codebook::NUM_SYMBOLS], const Codebook& codebook) {
+    uint64_t bits = 0;
+    for (size_t symbol = 0; symbol < Codebook::NUM_SYMBOLS; symbol++) {
+        bits += counts[symbol] * codebook.getCode((uint8_t)symbol).nBits;
+    }
+    return bits;
+}
\ No newline at end of file
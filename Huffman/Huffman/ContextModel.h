@@ -0,0 +1,95 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Codebook.h"
+
+using namespace std;
+
+
+
+/* ContextModel
+   ------------
+   Order-1 codes for one block, where the code for each byte depends
+   on the byte before it (its context). In text, the byte after a
+   space or a 'q' is far more predictable than a byte on its own, so
+   each context that is common enough gets its own codes built from
+   just the bytes that follow it. Every other context shares one
+   fallback table, so rare contexts do not each pay for a header.
+
+   The payload starts with which contexts have their own table, then
+   the lengths of the fallback table and of each own table in order of
+   context, then the coded bytes. The first byte of the block has the
+   context 0.
+
+   -------------------------------------------------------------------------
+   |                  |                   |                    |           |
+   |  Own Tables      |  Fallback Lengths |  Own Table Lengths |  Coded    |
+   |  (32B, 1 bit per |  (<=258B)         |  (<=258B each)     |  Bytes    |
+   |   context)       |                   |                    |  (Any)    |
+   -------------------------------------------------------------------------
+*/
+
+
+
+class ContextModel {
+public:
+
+    /* Constants */
+
+    static const size_t NUM_CONTEXTS = Codebook::NUM_SYMBOLS;
+    static const size_t OWN_TABLES_SIZE = NUM_CONTEXTS / 8;
+
+
+    /* Constructor */
+
+    ContextModel(const uint8_t* in, size_t size, uint32_t maxCodeLength);
+
+
+    /* Public Interface */
+
+
+    /* encodedSize
+       -----------
+       Returns exactly how many bytes encode will write for the block
+       the model was built from.
+    */
+
+    size_t encodedSize() const;
+
+
+    /* encode
+       ------
+       Writes the whole payload for the block the model was built from.
+       out needs room for encodedSize bytes plus 8 bytes of slack.
+       Returns the number of bytes written.
+    */
+
+    size_t encode(const uint8_t* in, size_t size, uint8_t* out) const;
+
+
+    /* decode
+       ------
+       Decodes a payload written by encode into exactly outSize bytes.
+       Returns false if the payload is corrupt.
+    */
+
+    static bool decode(const uint8_t* payload, size_t payloadSize, uint8_t* out, size_t outSize);
+
+
+private:
+
+    /* Private Variables */
+
+    vector<Codebook> tables;            //the fallback table, then every own table
+    uint16_t tableOf[NUM_CONTEXTS];     //which table each context uses
+    size_t payloadSize = 0;
+
+
+    /* Private Methods */
+
+    static void countPairs(const uint8_t* in, size_t size, vector<uint64_t>& counts);
+
+    static uint64_t codedBits(const uint64_t counts[Codebook::NUM_SYMBOLS], const Codebook& codebook);
+
+};
\ No newline at end of file
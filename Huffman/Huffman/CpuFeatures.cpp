@@ -0,0 +1,56 @@
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#endif
+
+#include "CpuFeatures.h"
+
+
+
+/* CpuFeatures
+   -----------
+   Asks the processor which instructions it has with cpuid.
+*/
+
+
+
+/* Public Interface */
+
+bool CpuFeatures::hasBMI2() {
+    static const bool bmi2 = detectBMI2();
+    return bmi2;
+}
+
+
+
+/* Private Methods */
+
+/* detectBMI2
+   ----------
+   BMI1 and BMI2 are bits 3 and 8 of ebx in leaf 7 of cpuid. Processors
+   that are not x86 never have them.
+*/
+
+bool CpuFeatures::detectBMI2() {
+    uint32_t ebx = 0;
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] >= 7) {
+        __cpuidex(info, 7, 0);
+        ebx = (uint32_t)info[1];
+    }
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    unsigned int a, b, c, d;
+    if (__get_cpuid_max(0, nullptr) >= 7) {
+        __cpuid_count(7, 0, a, b, c, d);
+        ebx = b;
+    }
+#endif
+
+    const uint32_t bmi1 = 1u << 3;
+    const uint32_t bmi2 = 1u << 8;
+    return (ebx & bmi1) && (ebx & bmi2);
+}
\ No newline at end of file
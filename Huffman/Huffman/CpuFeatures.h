@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+
+using namespace std;
+
+
+
+/* CpuFeatures
+   -----------
+   Finds out at run time which optional instructions the processor
+   has, so the hot loops can pick the fastest version of themselves
+   that is safe to run, and fall back to plain code everywhere else.
+
+   A function marked HUFFMAN_TARGET_BMI2 is compiled to use BMI2 (shifts
+   that do not touch the flags, and bzhi for masks) no matter how the
+   rest of the program is built, so it must only be called when hasBMI2
+   says so. The kernels it calls are marked HUFFMAN_FORCE_INLINE so they
+   are compiled again inside it. MSVC cannot target single functions,
+   so there the BMI2 versions are the same as the plain ones unless the
+   whole program is built with /arch:AVX2.
+*/
+
+
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define HUFFMAN_TARGET_BMI2 __attribute__((target("bmi,bmi2")))
+#define HUFFMAN_FORCE_INLINE inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define HUFFMAN_TARGET_BMI2
+#define HUFFMAN_FORCE_INLINE __forceinline
+#else
+#define HUFFMAN_TARGET_BMI2
+#define HUFFMAN_FORCE_INLINE inline
+#endif
+
+
+
+class CpuFeatures {
+public:
+
+    /* Public Interface */
+
+
+    /* hasBMI2
+       -------
+       Returns true if the processor has the BMI1 and BMI2 instructions.
+       Checked once, then remembered.
+    */
+
+    static bool hasBMI2();
+
+
+private:
+
+    /* Private Methods */
+
+    static bool detectBMI2();
+
+};
\ No newline at end of file
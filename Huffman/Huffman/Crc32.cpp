@@ -0,0 +1,78 @@
+#include <cstring>
+
+#include "Crc32.h"
+
+
+
+/* Crc32
+   -----
+   Slicing-by-8 CRC-32.
+*/
+
+
+
+/* Public Interface */
+
+/* update
+   ------
+   Folds in eight bytes at a time, each through its own table, and then
+   whatever is left one byte at a time.
+*/
+
+uint32_t Crc32::update(uint32_t crc, const uint8_t* data, size_t size) {
+    const uint32_t (&table)[NUM_TABLES][256] = tables();
+    crc = ~crc;
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint32_t low;
+        uint32_t high;
+        memcpy(&low, data + i, 4);
+        memcpy(&high, data + i + 4, 4);
+        low ^= crc;
+        crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF]
+            ^ table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24]
+            ^ table[3][high & 0xFF] ^ table[2][(high >> 8) & 0xFF]
+            ^ table[1][(high >> 16) & 0xFF] ^ table[0][high >> 24];
+    }
+    for (; i < size; i++) {
+        crc = table[0][(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+
+
+/* Private Methods */
+
+/* tables
+   ------
+   Builds the tables the first time they are needed. Table n folds in a
+   byte followed by n zero bytes. The loads in update assume a little
+   endian machine, as every target of this project is.
+*/
+
+const uint32_t (&Crc32::tables())[NUM_TABLES][256] {
+    struct Tables {
+        uint32_t entries[NUM_TABLES][256];
+
+        Tables() {
+            for (uint32_t byte = 0; byte < 256; byte++) {
+                uint32_t crc = byte;
+                for (size_t bit = 0; bit < 8; bit++) {
+                    crc = (crc & 1) ? (crc >> 1) ^ POLYNOMIAL : crc >> 1;
+                }
+                entries[0][byte] = crc;
+            }
+            for (size_t n = 1; n < NUM_TABLES; n++) {
+                for (size_t byte = 0; byte < 256; byte++) {
+                    uint32_t previous = entries[n - 1][byte];
+                    entries[n][byte] = entries[0][previous & 0xFF] ^ (previous >> 8);
+                }
+            }
+        }
+    };
+
+    static const Tables built;
+    return built.entries;
+}
\ No newline at end of file
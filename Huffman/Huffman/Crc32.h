@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+
+
+/* Crc32
+   -----
+   The CRC-32 checksum used by zip and gzip, for checking that data
+   came back out exactly as it went in. Eight bytes are folded in at a
+   time with eight tables, rather than one byte at a time with one, so
+   checking costs little next to compressing.
+*/
+
+
+
+class Crc32 {
+public:
+
+    /* Public Interface */
+
+
+    /* update
+       ------
+       Returns the checksum of everything the crc was over, followed by
+       size more bytes from data. Start with a crc of 0.
+    */
+
+    static uint32_t update(uint32_t crc, const uint8_t* data, size_t size);
+
+
+private:
+
+    /* Constants */
+
+    static const uint32_t POLYNOMIAL = 0xEDB88320; //reversed, least significant bit first
+    static const size_t NUM_TABLES = 8;
+
+
+    /* Private Methods */
+
+    static const uint32_t (&tables())[NUM_TABLES][256];
+
+};
\ No newline at end of file
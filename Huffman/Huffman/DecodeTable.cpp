@@ -0,0 +1,394 @@
+#include <algorithm>
+
+#include "CpuFeatures.h"
+#include "DecodeTable.h"
+
+
+
+/* DecodeTable
+   -----------
+   Lookup tables that decode one or two whole symbols per probe
+   instead of stepping through the binary tree bit by bit.
+*/
+
+
+
+/* Constants */
+
+constexpr uint32_t DecodeTable::TABLE_BITS;
+
+
+
+/* Constructor */
+
+/* Gathers every symbol that has a code and sorts them by their bits,
+   so codes that share a prefix sit next to each other. The primary
+   table and any sub-tables are then laid out in one vector. */
+
+DecodeTable::DecodeTable(const Codebook& codebook) {
+    vector<SymbolCode> codes;
+    for (size_t symbol = 0; symbol < Codebook::NUM_SYMBOLS; symbol++) {
+        const Codebook::Code& code = codebook.getCode((uint8_t)symbol);
+        if (code.nBits > 0) {
+            codes.push_back({ (uint8_t)symbol, code.bits, code.nBits });
+        }
+    }
+
+    sort(codes.begin(), codes.end(), [](const SymbolCode& a, const SymbolCode& b) {
+        return ((uint64_t)a.bits << (64 - a.nBits)) < ((uint64_t)b.bits << (64 - b.nBits));
+    });
+
+    entries.resize((size_t)1 << TABLE_BITS);
+    buildTable(0, TABLE_BITS, 0, codes, 0, codes.size());
+    pairSymbols();
+
+    stepBits = max(TABLE_BITS, codebook.maxLength());
+}
+
+
+
+/* Decompression Methods */
+
+/* decode
+   ------
+   Runs the BMI2 version of the decoder if the processor has it.
+*/
+
+size_t DecodeTable::decode(BitReader& reader, uint8_t* out, size_t capacity) const {
+    if (CpuFeatures::hasBMI2()) {
+        return decodeBMI2(reader, out, capacity);
+    }
+    return decodeScalar(reader, out, capacity);
+}
+
+size_t DecodeTable::decodeScalar(BitReader& reader, uint8_t* out, size_t capacity) const {
+    return decodeKernel(reader, out, capacity);
+}
+
+HUFFMAN_TARGET_BMI2 size_t DecodeTable::decodeBMI2(BitReader& reader, uint8_t* out, size_t capacity) const {
+    return decodeKernel(reader, out, capacity);
+}
+
+
+/* decodeKernel
+   ------------
+   Works on a local copy of the reader so the compiler can keep the
+   bit buffer in registers, and hands the final position back at the end.
+
+   The fast loop runs while there are at least 64 valid bits left,
+   which means a refill always leaves a whole code in the buffer.
+   It works out up front how many steps are safe, so no bounds checks
+   are needed per symbol. Each probe of the primary table writes both
+   of its symbols and then advances past however many were actually valid.
+
+   The tail loop handles the last few bits one symbol at a time, and
+   never consumes part of a code that runs past the valid bits. This
+   lets a caller hand over a stream in chunks and carry on from
+   exactly where the previous chunk stopped.
+*/
+
+HUFFMAN_FORCE_INLINE size_t DecodeTable::decodeKernel(BitReader& reader, uint8_t* out, size_t capacity) const {
+    const Entry* table = entries.data();
+    BitReader in = reader;
+    uint8_t* const begin = out;
+    uint8_t* const outEnd = out + capacity;
+
+    /* Fast loop */
+
+    size_t steps;
+    while ((steps = safeSteps(in, out, outEnd)) > 0) {
+        for (size_t i = 0; i < steps; i++) {
+            if (!decodeStep(table, in, out)) {
+                reader = in;
+                return out - begin;
+            }
+        }
+    }
+
+    /* Tail loop */
+
+    while (out < outEnd && in.bitsRemaining() > 0) {
+        BitReader probe = in;
+        probe.refill();
+
+        const Entry* entry = &table[probe.peek(TABLE_BITS)];
+        uint32_t levelBits = TABLE_BITS;
+
+        while (entry->nSymbols == 0 && entry->subBits != 0 && levelBits < probe.bitsRemaining()) {
+            probe.consume(levelBits);
+            probe.refill();
+            levelBits = entry->subBits;
+            entry = &table[entry->link + probe.peek(levelBits)];
+        }
+
+        if (entry->nSymbols == 0 || entry->firstBits > probe.bitsRemaining()) {
+            break; //the rest is padding, or the next code is cut off
+        }
+
+        *out++ = entry->symbols[0];
+        probe.consume(entry->firstBits);
+        in = probe;
+    }
+
+    reader = in;
+    return out - begin;
+}
+
+
+
+/* decodeStreams
+   -------------
+   Runs the BMI2 version of the decoder if the processor has it.
+*/
+
+bool DecodeTable::decodeStreams(BitReader readers[NUM_STREAMS], uint8_t* const out[NUM_STREAMS],
+                                const size_t capacity[NUM_STREAMS]) const {
+    if (CpuFeatures::hasBMI2()) {
+        return decodeStreamsBMI2(readers, out, capacity);
+    }
+    return decodeStreamsScalar(readers, out, capacity);
+}
+
+bool DecodeTable::decodeStreamsScalar(BitReader readers[NUM_STREAMS], uint8_t* const out[NUM_STREAMS],
+                                      const size_t capacity[NUM_STREAMS]) const {
+    return decodeStreamsKernel(readers, out, capacity);
+}
+
+HUFFMAN_TARGET_BMI2 bool DecodeTable::decodeStreamsBMI2(BitReader readers[NUM_STREAMS], uint8_t* const out[NUM_STREAMS],
+                                                        const size_t capacity[NUM_STREAMS]) const {
+    return decodeStreamsKernel(readers, out, capacity);
+}
+
+
+/* decodeStreamsKernel
+   -------------------
+   A single stream is one long chain where every step has to wait
+   for the one before it to know where its code starts. With several
+   independent streams, one step of each is taken per round of the
+   fast loop, so the processor can work on all of them at once.
+
+   Once any stream gets near its end, each one is finished on its
+   own by decode.
+*/
+
+HUFFMAN_FORCE_INLINE bool DecodeTable::decodeStreamsKernel(BitReader readers[NUM_STREAMS], uint8_t* const out[NUM_STREAMS],
+                                                            const size_t capacity[NUM_STREAMS]) const {
+    const Entry* table = entries.data();
+
+    BitReader in0 = readers[0], in1 = readers[1], in2 = readers[2], in3 = readers[3];
+    uint8_t* out0 = out[0];
+    uint8_t* out1 = out[1];
+    uint8_t* out2 = out[2];
+    uint8_t* out3 = out[3];
+    uint8_t* const end0 = out[0] + capacity[0];
+    uint8_t* const end1 = out[1] + capacity[1];
+    uint8_t* const end2 = out[2] + capacity[2];
+    uint8_t* const end3 = out[3] + capacity[3];
+
+    /* Fast loop, all streams together */
+
+    bool valid = true;
+    size_t steps;
+    while (valid && (steps = min(min(safeSteps(in0, out0, end0), safeSteps(in1, out1, end1)),
+                                 min(safeSteps(in2, out2, end2), safeSteps(in3, out3, end3)))) > 0) {
+        for (size_t i = 0; i < steps; i++) {
+            valid &= decodeStep(table, in0, out0);
+            valid &= decodeStep(table, in1, out1);
+            valid &= decodeStep(table, in2, out2);
+            valid &= decodeStep(table, in3, out3);
+        }
+    }
+    if (!valid) {
+        return false;
+    }
+
+    /* Finish each stream on its own */
+
+    readers[0] = in0;
+    readers[1] = in1;
+    readers[2] = in2;
+    readers[3] = in3;
+    uint8_t* const positions[NUM_STREAMS] = { out0, out1, out2, out3 };
+    uint8_t* const ends[NUM_STREAMS] = { end0, end1, end2, end3 };
+
+    for (size_t i = 0; i < NUM_STREAMS; i++) {
+        size_t remaining = ends[i] - positions[i];
+        if (decode(readers[i], positions[i], remaining) != remaining) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+
+/* decodeContexts
+   --------------
+   Runs the BMI2 version of the decoder if the processor has it.
+*/
+
+size_t DecodeTable::decodeContexts(const DecodeTable* const tables[Codebook::NUM_SYMBOLS], BitReader& reader,
+                                   uint8_t* out, size_t capacity) {
+    if (CpuFeatures::hasBMI2()) {
+        return decodeContextsBMI2(tables, reader, out, capacity);
+    }
+    return decodeContextsScalar(tables, reader, out, capacity);
+}
+
+size_t DecodeTable::decodeContextsScalar(const DecodeTable* const tables[Codebook::NUM_SYMBOLS], BitReader& reader,
+                                         uint8_t* out, size_t capacity) {
+    return decodeContextsKernel(tables, reader, out, capacity);
+}
+
+HUFFMAN_TARGET_BMI2 size_t DecodeTable::decodeContextsBMI2(const DecodeTable* const tables[Codebook::NUM_SYMBOLS],
+                                                           BitReader& reader, uint8_t* out, size_t capacity) {
+    return decodeContextsKernel(tables, reader, out, capacity);
+}
+
+
+/* decodeContextsKernel
+   --------------------
+   Like decode, but every symbol picks the table for the next one, so
+   a probe can never resolve two symbols at once. The fast loop counts
+   on every code being at most MAX_CODE_LENGTH bits, since the tables
+   can differ in how long their codes are. The last few symbols are
+   each decoded by their own table's decode, which never reads past
+   the valid bits.
+*/
+
+HUFFMAN_FORCE_INLINE size_t DecodeTable::decodeContextsKernel(const DecodeTable* const tables[Codebook::NUM_SYMBOLS],
+                                                              BitReader& reader, uint8_t* out, size_t capacity) {
+    const Entry* entries[Codebook::NUM_SYMBOLS];
+    for (size_t context = 0; context < Codebook::NUM_SYMBOLS; context++) {
+        entries[context] = tables[context]->entries.data();
+    }
+
+    BitReader in = reader;
+    uint8_t* const begin = out;
+    uint8_t* const outEnd = out + capacity;
+    uint8_t previous = 0;
+
+    /* Fast loop */
+
+    while (in.bitsRemaining() >= 64 && out < outEnd) {
+        size_t steps = (size_t)min<uint64_t>((in.bitsRemaining() - 64) / Codebook::MAX_CODE_LENGTH + 1,
+                                             (uint64_t)(outEnd - out));
+        for (size_t i = 0; i < steps; i++) {
+            if (!decodeSymbol(entries[previous], in, *out)) {
+                reader = in;
+                return out - begin;
+            }
+            previous = *out++;
+        }
+    }
+
+    /* Tail loop */
+
+    while (out < outEnd && tables[previous]->decode(in, out, 1) == 1) {
+        previous = *out++;
+    }
+
+    reader = in;
+    return out - begin;
+}
+
+
+
+/* Private Methods */
+
+/* buildTable
+   ----------
+   Fills the table at offset, which is indexed by the tableBits bits
+   that follow the first prefixBits bits of codes[first, last).
+
+   A code that ends within this table fills every entry that starts
+   with it. Longer codes that land on the same entry are next to each
+   other since the codes are sorted, and each such run gets a sub-table
+   just big enough for its longest code (capped at TABLE_BITS, beyond
+   which it links again).
+*/
+
+void DecodeTable::buildTable(size_t offset, uint32_t tableBits, uint32_t prefixBits,
+                             const vector<SymbolCode>& codes, size_t first, size_t last) {
+    size_t next = first;
+
+    while (next < last) {
+        const SymbolCode& code = codes[next];
+        uint32_t suffixBits = code.nBits - prefixBits;
+
+        if (suffixBits <= tableBits) {
+            uint32_t fillBits = tableBits - suffixBits;
+            uint64_t suffix = code.bits & ((1ull << suffixBits) - 1);
+            size_t start = offset + ((size_t)suffix << fillBits);
+
+            for (size_t i = 0; i < ((size_t)1 << fillBits); i++) {
+                Entry& entry = entries[start + i];
+                entry.symbols[0] = code.symbol;
+                entry.nSymbols = 1;
+                entry.nBits = (uint8_t)suffixBits;
+                entry.firstBits = (uint8_t)suffixBits;
+            }
+            next++;
+            continue;
+        }
+
+        /* Find the run of long codes that share this entry */
+
+        uint32_t index = tableIndex(code, prefixBits, tableBits);
+        uint32_t maxBits = 0;
+        size_t runEnd = next;
+        while (runEnd < last && codes[runEnd].nBits - prefixBits > tableBits
+               && tableIndex(codes[runEnd], prefixBits, tableBits) == index) {
+            maxBits = max(maxBits, codes[runEnd].nBits);
+            runEnd++;
+        }
+
+        uint32_t subBits = min(maxBits - prefixBits - tableBits, TABLE_BITS);
+        size_t subOffset = entries.size();
+        entries.resize(subOffset + ((size_t)1 << subBits));
+
+        Entry& link = entries[offset + index];
+        link.link = (uint32_t)subOffset;
+        link.subBits = (uint8_t)subBits;
+
+        buildTable(subOffset, subBits, prefixBits + tableBits, codes, next, runEnd);
+        next = runEnd;
+    }
+}
+
+
+/* tableIndex
+   ----------
+   Returns the tableBits bits of a code that follow its first prefixBits bits.
+*/
+
+uint32_t DecodeTable::tableIndex(const SymbolCode& code, uint32_t prefixBits, uint32_t tableBits) {
+    uint32_t suffixBits = code.nBits - prefixBits;
+    return (uint32_t)(code.bits >> (suffixBits - tableBits)) & ((1u << tableBits) - 1);
+}
+
+
+/* pairSymbols
+   -----------
+   For every primary entry whose symbol leaves some of the TABLE_BITS
+   bits unused, checks whether those bits also hold a whole second
+   symbol, and if so stores both so they are decoded in one probe.
+*/
+
+void DecodeTable::pairSymbols() {
+    const uint32_t mask = (1u << TABLE_BITS) - 1;
+
+    for (uint32_t index = 0; index <= mask; index++) {
+        Entry& entry = entries[index];
+        if (entry.nSymbols != 1) {
+            continue;
+        }
+
+        const Entry& next = entries[(index << entry.firstBits) & mask];
+        if (next.nSymbols > 0 && entry.firstBits + next.firstBits <= TABLE_BITS) {
+            entry.symbols[1] = next.symbols[0];
+            entry.nSymbols = 2;
+            entry.nBits = entry.firstBits + next.firstBits;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,262 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "BitReader.h"
+#include "Codebook.h"
+
+using namespace std;
+
+
+
+/* DecodeTable
+   -----------
+   Lookup tables built once from a codebook that replace walking
+   the binary tree one bit at a time.
+
+   The primary table is indexed by the next TABLE_BITS bits of the
+   stream. Each entry holds every whole symbol those bits resolve
+   to (up to two) along with how many bits they use. Codes that are
+   longer than the primary table link to smaller sub-tables that
+   are indexed by the following bits.
+
+   The decoding loops are built twice, once as plain code and once
+   for processors with BMI2, and the right one is picked at run time.
+*/
+
+
+
+class DecodeTable {
+public:
+
+    /* Constants */
+
+    static constexpr uint32_t TABLE_BITS = 11;
+    static const size_t NUM_STREAMS = 4;
+
+
+    /* Constructor */
+
+    DecodeTable(const Codebook& codebook);
+
+
+    /* Public Interface */
+
+
+    /* decode
+       ------
+       Decodes symbols from the reader into out until either the
+       reader runs out of valid bits or capacity symbols have been
+       written. Returns the number of symbols written.
+
+       A code that is cut off by the end of the reader's valid bits
+       is left unconsumed.
+    */
+
+    size_t decode(BitReader& reader, uint8_t* out, size_t capacity) const;
+
+
+    /* decodeOne
+       ---------
+       Decodes a single symbol, for when each symbol may need a different
+       table. Returns false if there is no valid code left in the reader.
+    */
+
+    inline bool decodeOne(BitReader& reader, uint8_t& symbol) const;
+
+
+    /* decodeStreams
+       -------------
+       Decodes NUM_STREAMS independent streams that share these codes,
+       each reader into its own out, until each has written exactly its
+       capacity in symbols. Returns false if any of them could not.
+    */
+
+    bool decodeStreams(BitReader readers[NUM_STREAMS], uint8_t* const out[NUM_STREAMS],
+                       const size_t capacity[NUM_STREAMS]) const;
+
+
+    /* decodeContexts
+       --------------
+       Decodes a stream where every symbol was coded with the table for
+       the symbol before it (the first with the table for 0), in the same
+       way as decode. Returns the number of symbols written.
+    */
+
+    static size_t decodeContexts(const DecodeTable* const tables[Codebook::NUM_SYMBOLS], BitReader& reader,
+                                 uint8_t* out, size_t capacity);
+
+
+private:
+
+    /* Entry
+       -----
+       A symbol entry (nSymbols > 0) holds the decoded bytes, the
+       total bits they use and the bits used by the first one alone.
+
+       A link entry (nSymbols == 0) points at a sub-table of 2^subBits
+       entries, or is invalid if subBits is 0.
+    */
+
+    struct Entry {
+        uint32_t link = 0;
+        uint8_t symbols[2] = { 0, 0 };
+        uint8_t nSymbols = 0;
+        uint8_t nBits = 0;
+        uint8_t firstBits = 0;
+        uint8_t subBits = 0;
+    };
+
+
+    /* SymbolCode
+       ----------
+       A symbol along with its code from the codebook.
+    */
+
+    struct SymbolCode {
+        uint8_t symbol;
+        uint32_t bits;
+        uint32_t nBits;
+    };
+
+
+    /* Private Variables */
+
+    vector<Entry> entries;
+    uint32_t stepBits = TABLE_BITS;
+
+
+    /* Private Methods */
+
+    size_t decodeScalar(BitReader& reader, uint8_t* out, size_t capacity) const;
+
+    size_t decodeBMI2(BitReader& reader, uint8_t* out, size_t capacity) const;
+
+    inline size_t decodeKernel(BitReader& reader, uint8_t* out, size_t capacity) const;
+
+    bool decodeStreamsScalar(BitReader readers[NUM_STREAMS], uint8_t* const out[NUM_STREAMS],
+                             const size_t capacity[NUM_STREAMS]) const;
+
+    bool decodeStreamsBMI2(BitReader readers[NUM_STREAMS], uint8_t* const out[NUM_STREAMS],
+                           const size_t capacity[NUM_STREAMS]) const;
+
+    inline bool decodeStreamsKernel(BitReader readers[NUM_STREAMS], uint8_t* const out[NUM_STREAMS],
+                                    const size_t capacity[NUM_STREAMS]) const;
+
+    static size_t decodeContextsScalar(const DecodeTable* const tables[Codebook::NUM_SYMBOLS], BitReader& reader,
+                                       uint8_t* out, size_t capacity);
+
+    static size_t decodeContextsBMI2(const DecodeTable* const tables[Codebook::NUM_SYMBOLS], BitReader& reader,
+                                     uint8_t* out, size_t capacity);
+
+    static inline size_t decodeContextsKernel(const DecodeTable* const tables[Codebook::NUM_SYMBOLS], BitReader& reader,
+                                              uint8_t* out, size_t capacity);
+
+    void buildTable(size_t offset, uint32_t tableBits, uint32_t prefixBits,
+                    const vector<SymbolCode>& codes, size_t first, size_t last);
+
+    static uint32_t tableIndex(const SymbolCode& code, uint32_t prefixBits, uint32_t tableBits);
+
+    void pairSymbols();
+
+    inline size_t safeSteps(const BitReader& in, const uint8_t* out, const uint8_t* outEnd) const;
+
+    static inline bool decodeStep(const Entry* table, BitReader& in, uint8_t*& out);
+
+    static inline bool decodeSymbol(const Entry* table, BitReader& in, uint8_t& symbol);
+
+};
+
+
+
+/* Inline Methods */
+
+/* safeSteps
+   ---------
+   Returns how many decodeSteps in a row can be taken without
+   checking for the end of the stream or of out. Every step writes
+   at most 2 symbols and uses at most stepBits bits, and needs at
+   least 64 valid bits left before it starts.
+*/
+
+inline size_t DecodeTable::safeSteps(const BitReader& in, const uint8_t* out, const uint8_t* outEnd) const {
+    uint64_t remaining = in.bitsRemaining();
+    if (remaining < 64 || outEnd - out < 2) {
+        return 0;
+    }
+    return (size_t)min<uint64_t>((remaining - 64) / stepBits + 1, (uint64_t)(outEnd - out) / 2);
+}
+
+
+/* decodeOne
+   ---------
+   Takes the fast path of decodeSymbol while there are enough bits for
+   it, and lets decode handle the last few.
+*/
+
+inline bool DecodeTable::decodeOne(BitReader& reader, uint8_t& symbol) const {
+    if (reader.bitsRemaining() >= 64) {
+        return decodeSymbol(entries.data(), reader, symbol);
+    }
+    return decode(reader, &symbol, 1) == 1;
+}
+
+
+/* decodeStep
+   ----------
+   Decodes one probe of the primary table, following links to sub-tables
+   for long codes, and writes its one or two symbols. Returns false,
+   without consuming anything, if no code starts with the next bits.
+*/
+
+inline bool DecodeTable::decodeStep(const Entry* table, BitReader& in, uint8_t*& out) {
+    in.refill();
+
+    const Entry* entry = &table[in.peek(TABLE_BITS)];
+    uint32_t levelBits = TABLE_BITS;
+
+    while (entry->nSymbols == 0) {
+        if (entry->subBits == 0) {
+            return false; //corrupt data, no code starts with these bits
+        }
+        in.consume(levelBits);
+        in.refill();
+        levelBits = entry->subBits;
+        entry = &table[entry->link + in.peek(levelBits)];
+    }
+
+    out[0] = entry->symbols[0];
+    out[1] = entry->symbols[1];
+    out += entry->nSymbols;
+    in.consume(entry->nBits);
+    return true;
+}
+
+
+/* decodeSymbol
+   ------------
+   The same as decodeStep, but only ever decodes the first symbol of an
+   entry, for when the table to use depends on the symbol before.
+*/
+
+inline bool DecodeTable::decodeSymbol(const Entry* table, BitReader& in, uint8_t& symbol) {
+    in.refill();
+
+    const Entry* entry = &table[in.peek(TABLE_BITS)];
+    uint32_t levelBits = TABLE_BITS;
+
+    while (entry->nSymbols == 0) {
+        if (entry->subBits == 0) {
+            return false; //corrupt data, no code starts with these bits
+        }
+        in.consume(levelBits);
+        in.refill();
+        levelBits = entry->subBits;
+        entry = &table[entry->link + in.peek(levelBits)];
+    }
+
+    symbol = entry->symbols[0];
+    in.consume(entry->firstBits);
+    return true;
+}
\ No newline at end of file
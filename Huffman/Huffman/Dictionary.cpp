@@ -0,0 +1,133 @@
+#include <fstream>
+
+#include "BlockCodec.h"
+#include "Dictionary.h"
+#include "FrequencyMap.h"
+
+
+
+/* Dictionary
+   ----------
+   Codes trained on sample data, shared by every message.
+*/
+
+
+
+/* Constructor */
+
+/* Builds the codes and the decode table up front, so no message ever
+   has to */
+
+Dictionary::Dictionary(uint32_t id, const uint8_t lengths[Codebook::NUM_SYMBOLS]) :
+    id(id), codebook(lengths), decodeTable(codebook) {
+}
+
+
+
+/* Public Interface */
+
+/* train
+   -----
+   Adds up the bytes of every sample file.
+*/
+
+unique_ptr<Dictionary> Dictionary::train(uint32_t id, const vector<string>& sampleFiles, uint32_t maxCodeLength) {
+    uint64_t counts[Codebook::NUM_SYMBOLS] = { 0 };
+    for (const string& sampleFile : sampleFiles) {
+        FrequencyMap freqMap(sampleFile);
+        for (size_t symbol = 0; symbol < Codebook::NUM_SYMBOLS; symbol++) {
+            counts[symbol] += freqMap.getFreq(symbol);
+        }
+    }
+    return fromCounts(id, counts, maxCodeLength);
+}
+
+/* The same, for samples that are already in memory */
+
+unique_ptr<Dictionary> Dictionary::train(uint32_t id, const uint8_t* samples, size_t size, uint32_t maxCodeLength) {
+    FrequencyMap freqMap(samples, size);
+    uint64_t counts[Codebook::NUM_SYMBOLS];
+    for (size_t symbol = 0; symbol < Codebook::NUM_SYMBOLS; symbol++) {
+        counts[symbol] = freqMap.getFreq(symbol);
+    }
+    return fromCounts(id, counts, maxCodeLength);
+}
+
+
+/* save
+   ----
+   Writes the header, the ID and the code lengths.
+*/
+
+bool Dictionary::save(string filename) const {
+    uint8_t buffer[8 + Codebook::MAX_LENGTHS_SIZE];
+    BlockCodec::putUInt32(buffer, MAGIC | ((uint32_t)DICTIONARY_TAG << 24));
+    BlockCodec::putUInt32(buffer + 4, id);
+    size_t size = 8 + codebook.writeLengths(buffer + 8);
+
+    ofstream outfile(filename, ios::binary);
+    outfile.write((const char*)buffer, size);
+    return (bool)outfile;
+}
+
+
+/* load
+   ----
+   Checks the header and the code lengths, and rebuilds the codes.
+   Trained dictionaries give every byte a code, so one that does not
+   could never code some messages and is turned down.
+*/
+
+unique_ptr<Dictionary> Dictionary::load(string filename) {
+    uint8_t buffer[8 + Codebook::MAX_LENGTHS_SIZE];
+    ifstream infile(filename, ios::binary);
+    infile.read((char*)buffer, sizeof(buffer));
+    size_t size = (size_t)infile.gcount();
+
+    uint8_t lengths[Codebook::NUM_SYMBOLS];
+    if (size < 8 || BlockCodec::getUInt32(buffer) != (MAGIC | ((uint32_t)DICTIONARY_TAG << 24))
+        || Codebook::readLengths(buffer + 8, size - 8, lengths) == 0) {
+        return nullptr;
+    }
+    for (size_t symbol = 0; symbol < Codebook::NUM_SYMBOLS; symbol++) {
+        if (lengths[symbol] == 0) {
+            return nullptr;
+        }
+    }
+    return unique_ptr<Dictionary>(new Dictionary(BlockCodec::getUInt32(buffer + 4), lengths));
+}
+
+
+/* Accessors */
+
+uint32_t Dictionary::getId() const {
+    return id;
+}
+
+const Codebook& Dictionary::getCodebook() const {
+    return codebook;
+}
+
+const DecodeTable& Dictionary::getDecodeTable() const {
+    return decodeTable;
+}
+
+
+
+/* Private Methods */
+
+/* fromCounts
+   ----------
+   Counts every byte at least once, so that bytes the samples never
+   had still get a (long) code, then builds the lengths.
+*/
+
+unique_ptr<Dictionary> Dictionary::fromCounts(uint32_t id, uint64_t counts[Codebook::NUM_SYMBOLS], uint32_t maxCodeLength) {
+    for (size_t symbol = 0; symbol < Codebook::NUM_SYMBOLS; symbol++) {
+        counts[symbol] = counts[symbol] + 1;
+    }
+
+    uint8_t lengths[Codebook::NUM_SYMBOLS];
+    Codebook::buildLengths(FrequencyMap(counts), maxCodeLength, lengths);
+    return unique_ptr<Dictionary>(new Dictionary(id, lengths));
+}
\ No newline at end of file
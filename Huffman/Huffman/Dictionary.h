@@ -0,0 +1,108 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Codebook.h"
+#include "DecodeTable.h"
+
+using namespace std;
+
+
+
+/* Dictionary
+   ----------
+   Codes trained ahead of time on samples of the data to come, for
+   compressing many small messages. A message on its own is too small
+   to be worth counting, and its code lengths could easily take more
+   room than the message itself, so instead every message is coded
+   with the dictionary's codes and nothing else is stored with it.
+
+   Every byte gets a code, even ones that never appeared in the
+   samples, so any message can be coded with any dictionary. The
+   codes and the decode table are built once, when the dictionary is
+   trained or loaded. Every message starts with the ID of the
+   dictionary it was coded with, and decompressMessage turns down a
+   message whose ID is not its dictionary's.
+
+   Dictionary file structure:
+
+   ---------------------------------------------------------
+   |               |               |                       |
+   |  "HUF" + 'D'  |  ID           |  Code Lengths         |
+   |  (4B)         |  (4B)         |  (<=258B)             |
+   ---------------------------------------------------------
+*/
+
+
+
+class Dictionary {
+public:
+
+    /* Constants */
+
+    static const uint32_t MAGIC = 0x465548; //"HUF", least significant byte first
+    static const uint8_t DICTIONARY_TAG = 'D';
+
+
+    /* Constructor */
+
+    Dictionary(uint32_t id, const uint8_t lengths[Codebook::NUM_SYMBOLS]);
+
+
+    /* Public Interface */
+
+
+    /* train
+       -----
+       Builds a dictionary from the bytes of sample files, or of samples
+       in memory, with no code longer than maxCodeLength bits.
+    */
+
+    static unique_ptr<Dictionary> train(uint32_t id, const vector<string>& sampleFiles, uint32_t maxCodeLength = 15);
+
+    static unique_ptr<Dictionary> train(uint32_t id, const uint8_t* samples, size_t size, uint32_t maxCodeLength = 15);
+
+
+    /* save
+       ----
+       Writes the dictionary to a file. Returns false if it could not.
+    */
+
+    bool save(string filename) const;
+
+
+    /* load
+       ----
+       Reads a dictionary written by save. Returns nullptr if the file
+       is missing or is not a valid dictionary, including one that leaves
+       any byte without a code.
+    */
+
+    static unique_ptr<Dictionary> load(string filename);
+
+
+    /* Accessors */
+
+    uint32_t getId() const;
+
+    const Codebook& getCodebook() const;
+
+    const DecodeTable& getDecodeTable() const;
+
+
+private:
+
+    /* Private Variables */
+
+    uint32_t id;
+    Codebook codebook;
+    DecodeTable decodeTable;
+
+
+    /* Private Methods */
+
+    static unique_ptr<Dictionary> fromCounts(uint32_t id, uint64_t counts[Codebook::NUM_SYMBOLS], uint32_t maxCodeLength);
+
+};
\ No newline at end of file
@@ -1,4 +1,9 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
 #include "FrequencyMap.h"
+#include "ThreadPool.h"
 
 
 
@@ -9,8 +14,72 @@
    in a file.
 */
 
-FrequencyMap::FrequencyMap(string filename) {
-    fillFrequencyMap(filename);
+
+
+/* Constants */
+
+constexpr size_t FrequencyMap::MAX_TABLE_RUN;
+
+
+
+FrequencyMap::FrequencyMap(string filename, size_t nThreads) {
+    fillFrequencyMap(filename, nThreads);
+}
+
+/* Counts the bytes of a buffer that is already in memory */
+
+FrequencyMap::FrequencyMap(const uint8_t* data, size_t size, size_t nThreads) {
+    addCounts(data, size, nThreads);
+}
+
+/* Takes counts that were already made some other way */
+
+FrequencyMap::FrequencyMap(const uint64_t counts[MAP_SIZE]) {
+    memcpy(freqs, counts, sizeof(freqs));
+}
+
+
+/* sample
+   ------
+   Reads and counts just the sampled chunks of a file, seeking from one
+   to the next, so the rest of the file is never read at all.
+*/
+
+FrequencyMap FrequencyMap::sample(string filename, size_t nChunks) {
+    ifstream infile(filename, ios::binary | ios::ate);
+    uint64_t fileSize = infile ? (uint64_t)infile.tellg() : 0;
+    if (nChunks == 0 || fileSize <= (uint64_t)nChunks * SAMPLE_CHUNK_SIZE) {
+        infile.close();
+        FrequencyMap freqMap(filename);
+        addFloor(freqMap.freqs);
+        return freqMap;
+    }
+
+    uint64_t counts[MAP_SIZE] = { 0 };
+    vector<uint8_t> chunk(SAMPLE_CHUNK_SIZE);
+    for (size_t i = 0; i < nChunks; i++) {
+        infile.seekg((streamoff)sampleOffset(fileSize, i, nChunks));
+        infile.read((char*)chunk.data(), chunk.size());
+        countBytes(chunk.data(), (size_t)infile.gcount(), counts);
+    }
+    addFloor(counts);
+    return FrequencyMap(counts);
+}
+
+/* The same, for a buffer that is already in memory */
+
+FrequencyMap FrequencyMap::sample(const uint8_t* data, size_t size, size_t nChunks) {
+    uint64_t counts[MAP_SIZE] = { 0 };
+    if (nChunks == 0 || size <= nChunks * SAMPLE_CHUNK_SIZE) {
+        countBytes(data, size, counts);
+    }
+    else {
+        for (size_t i = 0; i < nChunks; i++) {
+            countBytes(data + sampleOffset(size, i, nChunks), SAMPLE_CHUNK_SIZE, counts);
+        }
+    }
+    addFloor(counts);
+    return FrequencyMap(counts);
 }
 
 
@@ -19,7 +88,7 @@ FrequencyMap::FrequencyMap(string filename) {
    Returns the frequency associated with a byte
 */
 
-const uint32_t FrequencyMap::getFreq(size_t index) const {
+const uint64_t FrequencyMap::getFreq(size_t index) const {
     return freqs[index];
 }
 
@@ -36,22 +105,176 @@ const size_t FrequencyMap::size() const {
 
 /* fillFrequencyMap
    ----------------
-   Maps each byte in the file to its frequency. We must first
-   get the byte as a char, then cast to an uint8_t due to
-   the istream >> (unsigned char) not picking up certain ascii
-   values, including returns and spaces. Very annoying bug.
+   Maps each byte in the file to its frequency. The file is read
+   in large chunks straight into memory, rather than one char at
+   a time through the stream, and each chunk is counted as a whole.
+
+   A file that fits in one chunk is just counted here. Otherwise one
+   pool is started for the whole file, and the chunks take turns in
+   two buffers: while the pool counts one, the next is read into the
+   other, so the disk and the counting threads are busy at the same
+   time. Every thread keeps its own table across all the chunks, and
+   the tables are added into the map at the very end.
 */
 
-void FrequencyMap::fillFrequencyMap(const string filename) {
+void FrequencyMap::fillFrequencyMap(const string filename, size_t nThreads) {
     ifstream infile;
     infile.open(filename, ios::binary);
 
-    char ch;
-    uint8_t byte;
-    while (infile.get(ch)) {
-        byte = (uint8_t)ch;
-        freqs[byte]++;
+    vector<uint8_t> chunks[2] = { vector<uint8_t>(CHUNK_SIZE), vector<uint8_t>(CHUNK_SIZE) };
+    const auto readChunk = [&](vector<uint8_t>& chunk) {
+        infile.read((char*)chunk.data(), chunk.size());
+        return (size_t)infile.gcount();
+    };
+
+    size_t size = readChunk(chunks[0]);
+    if (size < CHUNK_SIZE) {
+        countBytes(chunks[0].data(), size, freqs);
+        return;
     }
 
+    size_t nSlices = max<size_t>(1, min(nThreads, CHUNK_SIZE / MIN_SLICE_SIZE));
+    ThreadPool pool(nSlices);
+    vector<uint64_t> sliceCounts(nSlices * MAP_SIZE, 0);
+
+    for (size_t current = 0; size > 0; current ^= 1) {
+        countSlices(pool, chunks[current].data(), size, sliceCounts);
+        size_t nextSize = readChunk(chunks[current ^ 1]);
+        pool.wait();
+        size = nextSize;
+    }
+
+    addSliceCounts(sliceCounts);
     infile.close();
+}
+
+
+/* addCounts
+   ---------
+   Gives every thread a slice of the buffer and a private table to
+   count it into, so no two threads ever touch the same counter.
+   The tables are added into the map once they are all done. A
+   buffer too small to be worth splitting is just counted here.
+*/
+
+void FrequencyMap::addCounts(const uint8_t* data, size_t size, size_t nThreads) {
+    size_t nSlices = max<size_t>(1, min(nThreads, size / MIN_SLICE_SIZE));
+    if (nSlices == 1) {
+        countBytes(data, size, freqs);
+        return;
+    }
+
+    vector<uint64_t> sliceCounts(nSlices * MAP_SIZE, 0);
+    ThreadPool pool(nSlices);
+    countSlices(pool, data, size, sliceCounts);
+    pool.wait();
+    addSliceCounts(sliceCounts);
+}
+
+
+/* countSlices
+   -----------
+   Splits the buffer into one slice for each table in sliceCounts and
+   submits them to the pool, each to be counted into its own table.
+   Returns straight away, so the caller must wait on the pool before
+   touching the buffer or the tables.
+*/
+
+void FrequencyMap::countSlices(ThreadPool& pool, const uint8_t* data, size_t size, vector<uint64_t>& sliceCounts) {
+    size_t nSlices = sliceCounts.size() / MAP_SIZE;
+    for (size_t slice = 0; slice < nSlices; slice++) {
+        size_t first = size * slice / nSlices;
+        size_t last = size * (slice + 1) / nSlices;
+        uint64_t* counts = &sliceCounts[slice * MAP_SIZE];
+        pool.submit([data, first, last, counts] {
+            countBytes(data + first, last - first, counts);
+        });
+    }
+}
+
+
+/* addSliceCounts
+   --------------
+   Adds every slice's table into the map.
+*/
+
+void FrequencyMap::addSliceCounts(const vector<uint64_t>& sliceCounts) {
+    for (size_t slice = 0; slice < sliceCounts.size() / MAP_SIZE; slice++) {
+        for (size_t byte = 0; byte < MAP_SIZE; byte++) {
+            freqs[byte] += sliceCounts[slice * MAP_SIZE + byte];
+        }
+    }
+}
+
+
+/* countBytes
+   ----------
+   A single table is slow on runs of the same byte, since every
+   increment has to wait for the one before it to be stored. Here
+   eight bytes are loaded at once and spread over NUM_TABLES tables,
+   so neighbouring bytes land in different tables and the increments
+   can overlap.
+
+   The tables are 32-bit to keep them small, so they are added into
+   the 64-bit counts after every MAX_TABLE_RUN bytes, long before any
+   of them could overflow.
+*/
+
+void FrequencyMap::countBytes(const uint8_t* data, size_t size, uint64_t counts[MAP_SIZE]) {
+    uint32_t tables[NUM_TABLES][MAP_SIZE];
+
+    for (size_t runStart = 0; runStart < size; runStart += MAX_TABLE_RUN) {
+        const uint8_t* run = data + runStart;
+        size_t runSize = min(size - runStart, MAX_TABLE_RUN);
+        memset(tables, 0, sizeof(tables));
+
+        size_t i = 0;
+        for (; i + 8 <= runSize; i += 8) {
+            uint64_t word;
+            memcpy(&word, run + i, sizeof(word));
+            tables[0][(uint8_t)word]++;
+            tables[1][(uint8_t)(word >> 8)]++;
+            tables[2][(uint8_t)(word >> 16)]++;
+            tables[3][(uint8_t)(word >> 24)]++;
+            tables[0][(uint8_t)(word >> 32)]++;
+            tables[1][(uint8_t)(word >> 40)]++;
+            tables[2][(uint8_t)(word >> 48)]++;
+            tables[3][(uint8_t)(word >> 56)]++;
+        }
+        for (; i < runSize; i++) {
+            tables[0][run[i]]++;
+        }
+
+        for (size_t byte = 0; byte < MAP_SIZE; byte++) {
+            counts[byte] += (uint64_t)tables[0][byte] + tables[1][byte] + tables[2][byte] + tables[3][byte];
+        }
+    }
+}
+
+
+/* sampleOffset
+   ------------
+   Spreads the chunks so that the first starts at the very beginning
+   and the last ends at the very end, with equal gaps between them.
+   Only called when the input is bigger than the whole sample.
+*/
+
+uint64_t FrequencyMap::sampleOffset(uint64_t size, size_t chunk, size_t nChunks) {
+    if (nChunks == 1) {
+        return (size - SAMPLE_CHUNK_SIZE) / 2;
+    }
+    return (size - SAMPLE_CHUNK_SIZE) * chunk / (nChunks - 1);
+}
+
+
+/* addFloor
+   --------
+   A byte with a count of 0 would get no code, and a sample can easily
+   miss bytes that are rare but still there, so each gets a count of 1.
+*/
+
+void FrequencyMap::addFloor(uint64_t counts[MAP_SIZE]) {
+    for (size_t byte = 0; byte < MAP_SIZE; byte++) {
+        counts[byte] = max<uint64_t>(counts[byte], 1);
+    }
 }
\ No newline at end of file
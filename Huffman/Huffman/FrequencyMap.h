@@ -1,5 +1,9 @@
 #pragma once
+#include <cstdint>
 #include <fstream>
+#include <vector>
+
+#include "ThreadPool.h"
 
 using namespace std;
 
@@ -10,6 +14,14 @@ using namespace std;
    Maps each combination of bits that can appear in one
    byte, from 0 to 255, to the frequency that it appears
    in a file.
+
+   Bytes are counted out of large buffers in memory, spread
+   over several count tables that are added up at the end.
+   Big inputs can also be split between threads, each with
+   its own tables.
+
+   A map can also be sampled from evenly spaced chunks of a
+   big input, for an estimate in a fraction of the time.
 */
 
 
@@ -21,24 +33,50 @@ private:
     /* Constants */
 
     static const size_t MAP_SIZE = 256;
+    static const size_t NUM_TABLES = 4;
+    static const size_t CHUNK_SIZE = 1 << 22;
+    static const size_t MIN_SLICE_SIZE = 1 << 18;
+    static const size_t SAMPLE_CHUNK_SIZE = 1 << 16;
 
 
 public:
 
+    /* Constants */
+
+    static constexpr size_t MAX_TABLE_RUN = (size_t)1 << 30; //bytes counted into the 32-bit tables at a time
+
+
 	/* Constructor */
 
-	FrequencyMap(string filename);
+	FrequencyMap(string filename, size_t nThreads = 1);
+
+    FrequencyMap(const uint8_t* data, size_t size, size_t nThreads = 1);
+
+    FrequencyMap(const uint64_t counts[MAP_SIZE]);
 
 
     /* Public Interface */
 
 
+    /* sample
+       ------
+       Counts nChunks chunks of 64KB spread evenly from the start of
+       the input to its end, instead of the whole input. Every byte is
+       then counted at least once, so that bytes the sample missed still
+       get a code. An input no bigger than the sample is counted whole.
+    */
+
+    static FrequencyMap sample(string filename, size_t nChunks);
+
+    static FrequencyMap sample(const uint8_t* data, size_t size, size_t nChunks);
+
+
     /* getFreq
        -------
        Returns the frequency associated with a byte
     */
 
-    const uint32_t getFreq(size_t index) const;
+    const uint64_t getFreq(size_t index) const;
 
 
     /* size()
@@ -53,7 +91,7 @@ private:
 
 	/* Private Variables */
 
-    uint32_t freqs[MAP_SIZE] = { 0 };
+    uint64_t freqs[MAP_SIZE] = { 0 };
 
 
     /* fillFrequencyMap
@@ -61,7 +99,56 @@ private:
        Maps each byte in the file to its frequency.
     */
 
-    void fillFrequencyMap(const string filename);
+    void fillFrequencyMap(const string filename, size_t nThreads);
+
+
+    /* addCounts
+       ---------
+       Adds the frequency of each byte in a buffer, splitting it
+       between up to nThreads threads.
+    */
+
+    void addCounts(const uint8_t* data, size_t size, size_t nThreads);
+
+
+    /* countSlices
+       -----------
+       Hands the pool a slice of a buffer for each table in sliceCounts.
+    */
+
+    static void countSlices(ThreadPool& pool, const uint8_t* data, size_t size, vector<uint64_t>& sliceCounts);
+
+
+    /* addSliceCounts
+       --------------
+       Adds the tables of every slice into the map.
+    */
+
+    void addSliceCounts(const vector<uint64_t>& sliceCounts);
+
+
+    /* countBytes
+       ----------
+       Adds the frequency of each byte in a buffer to counts.
+    */
+
+    static void countBytes(const uint8_t* data, size_t size, uint64_t counts[MAP_SIZE]);
+
+
+    /* sampleOffset
+       ------------
+       Returns where the given chunk of a sample starts.
+    */
+
+    static uint64_t sampleOffset(uint64_t size, size_t chunk, size_t nChunks);
+
+
+    /* addFloor
+       --------
+       Counts every byte at least once.
+    */
+
+    static void addFloor(uint64_t counts[MAP_SIZE]);
 
 };
 
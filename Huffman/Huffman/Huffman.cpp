@@ -1,6 +1,19 @@
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
 
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#include <stdio.h>
+#endif
+
+#include "Benchmark.h"
 #include "HuffmanCompressor.h"
+#include "LargeInputCheck.h"
 
 using namespace std;
 
@@ -10,21 +23,142 @@ using namespace std;
 const string TEXT = "Text.txt";
 const string CMP = "Compressed.txt";
 const string DECOMPRESSED = "Decompressed.txt";
+const string STANDARD_STREAM = "-";
 
 
 /* Functions */
 
 void createTestFile(const string filename);
 
+int runCommand(const string& command, const string& input, const string& output);
+
+int runRangeCommand(const string& offset, const string& length, const string& input, const string& output);
+
+int runTrainCommand(const string& dictionary, const string& id, const vector<string>& samples);
+
+int runMessageCommand(const string& command, const string& dictionary, const string& input, const string& output);
+
+int runBatchCommand(const string& list);
+
+int runArchiveCommand(const string& command, const string& archive, const vector<string>& arguments);
+
+int runBenchmarkCommand(const vector<string>& files);
+
+int runCheckCommand(const string& gigabytes);
+
+void useBinaryStandardStreams();
+
 
 /* main 
    ----
-   Uses an instance of a HuffmanCompressor to take an input 
-   file given by TEXT, and compresses it into CMP, only to 
+   With no arguments, uses an instance of a HuffmanCompressor to take
+   an input file given by TEXT, and compresses it into CMP, only to
    decompress it back into DECOMPRESSED.
+
+   Otherwise compresses (-c) or decompresses (-d) one file into another:
+
+       Huffman -c [input] [output]
+       Huffman -d [input] [output]
+
+   A missing or "-" input or output means stdin or stdout, so it can
+   sit in the middle of a shell pipeline.
+
+   Or decompresses just length bytes from offset in the original data,
+   which needs a real compressed file to seek around in:
+
+       Huffman -r offset length input [output]
+
+   Or trains a dictionary on sample files, for compressing small
+   messages with HuffmanCompressor::compressMessage:
+
+       Huffman -t dictionary id sample...
+
+   Then compresses (-mc) or decompresses (-md) one message with it:
+
+       Huffman -mc dictionary [input] [output]
+       Huffman -md dictionary [input] [output]
+
+   Or compresses a whole batch of files at once, listed one per line
+   in list (or on stdin), as the input and output names separated by a
+   tab. A line with no output compresses input into input.huf:
+
+       Huffman -b [list]
+
+   Or puts files into an archive, stored under the names they were
+   given by, then lists the archive or extracts one member by name:
+
+       Huffman -a archive file...
+       Huffman -l archive
+       Huffman -x archive name [output]
+
+   Or times every phase of compression on the given files, or on the
+   standard corpus if there are none, and writes the results to stdout
+   as tab separated columns, for comparing builds:
+
+       Huffman -bench [file...]
+
+   Or checks that an input of the given number of GiB (5 if none is
+   given) comes back out exactly through the streaming compressor and
+   decompressor, and that counting gets past the 32-bit tables, all
+   without touching the disk:
+
+       Huffman -check [gigabytes]
 */
 
-uint32_t main() {
+int main(int argc, char* argv[]) {
+
+    if (argc > 1 && string(argv[1]) == "-r") {
+        if (argc < 5) {
+            cerr << "Usage: Huffman -r offset length input [output|-]" << endl;
+            return 2;
+        }
+        string output = (argc > 5) ? argv[5] : STANDARD_STREAM;
+        return runRangeCommand(argv[2], argv[3], argv[4], output);
+    }
+
+    if (argc > 1 && string(argv[1]) == "-t") {
+        if (argc < 5) {
+            cerr << "Usage: Huffman -t dictionary id sample..." << endl;
+            return 2;
+        }
+        return runTrainCommand(argv[2], argv[3], vector<string>(argv + 4, argv + argc));
+    }
+
+    if (argc > 1 && (string(argv[1]) == "-mc" || string(argv[1]) == "-md")) {
+        if (argc < 3) {
+            cerr << "Usage: Huffman -mc|-md dictionary [input|-] [output|-]" << endl;
+            return 2;
+        }
+        string input = (argc > 3) ? argv[3] : STANDARD_STREAM;
+        string output = (argc > 4) ? argv[4] : STANDARD_STREAM;
+        return runMessageCommand(argv[1], argv[2], input, output);
+    }
+
+    if (argc > 1 && (string(argv[1]) == "-a" || string(argv[1]) == "-l" || string(argv[1]) == "-x")) {
+        if (argc < 3) {
+            cerr << "Usage: Huffman -a archive file... | -l archive | -x archive name [output|-]" << endl;
+            return 2;
+        }
+        return runArchiveCommand(argv[1], argv[2], vector<string>(argv + 3, argv + argc));
+    }
+
+    if (argc > 1 && string(argv[1]) == "-bench") {
+        return runBenchmarkCommand(vector<string>(argv + 2, argv + argc));
+    }
+
+    if (argc > 1 && string(argv[1]) == "-check") {
+        return runCheckCommand((argc > 2) ? argv[2] : "");
+    }
+
+    if (argc > 1 && string(argv[1]) == "-b") {
+        return runBatchCommand((argc > 2) ? argv[2] : STANDARD_STREAM);
+    }
+
+    if (argc > 1) {
+        string input = (argc > 2) ? argv[2] : STANDARD_STREAM;
+        string output = (argc > 3) ? argv[3] : STANDARD_STREAM;
+        return runCommand(argv[1], input, output);
+    }
 
     HuffmanCompressor c;
 
@@ -47,6 +181,335 @@ uint32_t main() {
         c.decompressFile(CMP, DECOMPRESSED);
         cout << "Done. Results are in " << DECOMPRESSED << endl;
     }
+
+    return 0;
+}
+
+
+/* runCommand
+   ----------
+   Two real files go through compressFile and decompressFile, which can
+   seek around the compressed file to work on many blocks at once. If
+   either end is stdin or stdout, the streaming versions are used, which
+   never seek. Nothing but compressed or decompressed data is ever
+   written to stdout.
+*/
+
+int runCommand(const string& command, const string& input, const string& output) {
+    HuffmanCompressor c;
+    bool compress = (command == "-c");
+
+    if (!compress && command != "-d") {
+        cerr << "Usage: Huffman -c|-d [input|-] [output|-]" << endl;
+        return 2;
+    }
+
+    if (input != STANDARD_STREAM && output != STANDARD_STREAM) {
+        bool succeeded = compress ? c.compressFile(input, output) : c.decompressFile(input, output);
+        if (!succeeded) {
+            cerr << (compress ? "Compression failed." : "Decompression failed, the input is corrupt.") << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    useBinaryStandardStreams();
+
+    ifstream infile;
+    ofstream outfile;
+    if (input != STANDARD_STREAM) {
+        infile.open(input, ios::binary);
+    }
+    if (output != STANDARD_STREAM) {
+        outfile.open(output, ios::binary);
+    }
+    istream& in = (input != STANDARD_STREAM) ? (istream&)infile : cin;
+    ostream& out = (output != STANDARD_STREAM) ? (ostream&)outfile : cout;
+
+    bool succeeded = compress ? c.compressStream(in, out) : c.decompressStream(in, out);
+    out.flush();
+
+    if (!succeeded) {
+        cerr << (compress ? "Compression failed." : "Decompression failed, the input is corrupt.") << endl;
+        return 1;
+    }
+    return 0;
+}
+
+
+/* runRangeCommand
+   ---------------
+   Decompresses one range of a compressed file with decompressRange,
+   and writes it to output or stdout.
+*/
+
+int runRangeCommand(const string& offset, const string& length, const string& input, const string& output) {
+    char* offsetEnd;
+    char* lengthEnd;
+    uint64_t rangeOffset = strtoull(offset.c_str(), &offsetEnd, 10);
+    uint64_t rangeLength = strtoull(length.c_str(), &lengthEnd, 10);
+    if (offset.empty() || length.empty() || *offsetEnd != 0 || *lengthEnd != 0) {
+        cerr << "Usage: Huffman -r offset length input [output|-]" << endl;
+        return 2;
+    }
+
+    HuffmanCompressor c;
+    vector<uint8_t> range;
+
+    if (!c.decompressRange(input, rangeOffset, rangeLength, range)) {
+        cerr << "Decompression failed, the input is corrupt or too short." << endl;
+        return 1;
+    }
+
+    useBinaryStandardStreams();
+
+    ofstream outfile;
+    if (output != STANDARD_STREAM) {
+        outfile.open(output, ios::binary);
+    }
+    ostream& out = (output != STANDARD_STREAM) ? (ostream&)outfile : cout;
+    out.write((const char*)range.data(), range.size());
+    out.flush();
+    return out ? 0 : 1;
+}
+
+
+/* runTrainCommand
+   ---------------
+   Trains a dictionary on every sample file and saves it, tagged with
+   id, to the dictionary file.
+*/
+
+int runTrainCommand(const string& dictionary, const string& id, const vector<string>& samples) {
+    char* idEnd;
+    unsigned long long dictionaryId = strtoull(id.c_str(), &idEnd, 10);
+    if (id.empty() || *idEnd != 0 || dictionaryId > 0xFFFFFFFF) {
+        cerr << "Usage: Huffman -t dictionary id sample..." << endl;
+        return 2;
+    }
+
+    unique_ptr<Dictionary> trained = Dictionary::train((uint32_t)dictionaryId, samples);
+    if (!trained->save(dictionary)) {
+        cerr << "Could not write " << dictionary << "." << endl;
+        return 1;
+    }
+    return 0;
+}
+
+
+/* runMessageCommand
+   -----------------
+   Loads the dictionary, reads the whole message into memory, and
+   compresses or decompresses it with compressMessage or
+   decompressMessage. A message coded with another dictionary is
+   turned down, the same as a corrupt one.
+*/
+
+int runMessageCommand(const string& command, const string& dictionary, const string& input, const string& output) {
+    unique_ptr<Dictionary> loaded = Dictionary::load(dictionary);
+    if (!loaded) {
+        cerr << "Could not load " << dictionary << "." << endl;
+        return 1;
+    }
+
+    useBinaryStandardStreams();
+
+    ifstream infile;
+    if (input != STANDARD_STREAM) {
+        infile.open(input, ios::binary);
+    }
+    istream& in = (input != STANDARD_STREAM) ? (istream&)infile : cin;
+    vector<uint8_t> message((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+    HuffmanCompressor c;
+    vector<uint8_t> result;
+    bool compress = (command == "-mc");
+    bool succeeded = compress ? c.compressMessage(*loaded, message.data(), message.size(), result) != 0
+                              : c.decompressMessage(*loaded, message.data(), message.size(), result);
+    if (!succeeded) {
+        cerr << (compress ? "Compression failed." : "Decompression failed, the input is corrupt or was coded with another dictionary.") << endl;
+        return 1;
+    }
+
+    ofstream outfile;
+    if (output != STANDARD_STREAM) {
+        outfile.open(output, ios::binary);
+    }
+    ostream& out = (output != STANDARD_STREAM) ? (ostream&)outfile : cout;
+    out.write((const char*)result.data(), result.size());
+    out.flush();
+    return out ? 0 : 1;
+}
+
+
+/* runBatchCommand
+   ---------------
+   Reads the list of files, compresses them with compressBatch, then
+   reports the files that failed and the throughput of the batch.
+*/
+
+int runBatchCommand(const string& list) {
+    ifstream listfile;
+    if (list != STANDARD_STREAM) {
+        listfile.open(list);
+        if (!listfile) {
+            cerr << "Could not read " << list << "." << endl;
+            return 1;
+        }
+    }
+    istream& in = (list != STANDARD_STREAM) ? (istream&)listfile : cin;
+
+    vector<HuffmanCompressor::BatchFile> files;
+    string line;
+    while (getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            continue;
+        }
+        size_t tab = line.find('\t');
+        if (tab == string::npos) {
+            files.push_back({ line, line + ".huf" });
+        }
+        else {
+            files.push_back({ line.substr(0, tab), line.substr(tab + 1) });
+        }
+    }
+
+    HuffmanCompressor c;
+    HuffmanCompressor::BatchResult result = c.compressBatch(files);
+
+    for (size_t i : result.failed) {
+        cerr << "Could not compress " << files[i].input << "." << endl;
+    }
+    cout << "Compressed " << (result.nFiles - result.failed.size()) << " of " << result.nFiles << " files, "
+         << result.bytesIn << " bytes into " << result.bytesOut << " bytes in " << result.seconds << " s ("
+         << result.megabytesPerSecond() << " MB/s)" << endl;
+    return result.failed.empty() ? 0 : 1;
+}
+
+
+/* runArchiveCommand
+   -----------------
+   Creates an archive of the given files (-a), lists the members of one
+   (-l) or extracts a single member (-x). "-" as the archive to create,
+   or the output to extract to, means stdout.
+*/
+
+int runArchiveCommand(const string& command, const string& archive, const vector<string>& arguments) {
+    HuffmanCompressor c;
+
+    if (command == "-l") {
+        vector<HuffmanCompressor::ArchiveEntry> directory;
+        if (!c.readArchiveDirectory(archive, directory)) {
+            cerr << archive << " is not a valid archive." << endl;
+            return 1;
+        }
+        for (const HuffmanCompressor::ArchiveEntry& entry : directory) {
+            cout << entry.name << "\t" << entry.uncompressedSize << "\t" << entry.compressedSize << endl;
+        }
+        return 0;
+    }
+
+    if (command == "-x" && (arguments.empty() || arguments.size() > 2)) {
+        cerr << "Usage: Huffman -x archive name [output|-]" << endl;
+        return 2;
+    }
+
+    useBinaryStandardStreams();
+
+    string output = (command == "-a") ? archive : (arguments.size() > 1) ? arguments[1] : STANDARD_STREAM;
+    ofstream outfile;
+    if (output != STANDARD_STREAM) {
+        outfile.open(output, ios::binary);
+    }
+    ostream& out = (output != STANDARD_STREAM) ? (ostream&)outfile : cout;
+
+    if (command == "-a") {
+        vector<HuffmanCompressor::ArchiveMember> members;
+        for (const string& file : arguments) {
+            members.push_back({ file, file });
+        }
+        if (!c.writeArchive(members, out)) {
+            cerr << "Could not write the archive." << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (!c.extractMember(archive, arguments[0], out)) {
+        cerr << "Could not extract " << arguments[0] << ", it is missing or corrupt." << endl;
+        return 1;
+    }
+    return 0;
+}
+
+
+/* runBenchmarkCommand
+   -------------------
+   Loads the files, or generates the standard corpus, then benchmarks
+   one case at a time, writing each line as soon as it is measured.
+*/
+
+int runBenchmarkCommand(const vector<string>& files) {
+    vector<Benchmark::Case> corpus;
+    if (files.empty()) {
+        corpus = Benchmark::standardCorpus();
+    }
+    for (const string& file : files) {
+        corpus.emplace_back();
+        if (!Benchmark::loadCase(file, corpus.back())) {
+            cerr << "Could not read " << file << "." << endl;
+            return 1;
+        }
+    }
+
+    Benchmark benchmark;
+    Benchmark::writeHeader(cout);
+    for (const Benchmark::Case& benchmarkCase : corpus) {
+        benchmark.run(benchmarkCase, cout);
+    }
+    return 0;
+}
+
+
+/* runCheckCommand
+   ---------------
+   Runs the counting check, then the much longer stream check, writing
+   a line for each as it finishes.
+*/
+
+int runCheckCommand(const string& gigabytes) {
+    uint64_t size = LargeInputCheck::DEFAULT_SIZE;
+    if (!gigabytes.empty()) {
+        char* gigabytesEnd;
+        double nGigabytes = strtod(gigabytes.c_str(), &gigabytesEnd);
+        if (*gigabytesEnd != 0 || nGigabytes <= 0) {
+            cerr << "Usage: Huffman -check [gigabytes]" << endl;
+            return 2;
+        }
+        size = (uint64_t)(nGigabytes * (1 << 30));
+    }
+
+    bool countsMatch = LargeInputCheck::checkCounts(cout);
+    bool streamMatches = LargeInputCheck(size).checkStream(cout);
+    return (countsMatch && streamMatches) ? 0 : 1;
+}
+
+
+/* useBinaryStandardStreams
+   ------------------------
+   Stops Windows from translating line endings on stdin and stdout,
+   which would corrupt binary data. Elsewhere they are already binary.
+*/
+
+void useBinaryStandardStreams() {
+    ios::sync_with_stdio(false);
+#if defined(_WIN32)
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
 }
 
 
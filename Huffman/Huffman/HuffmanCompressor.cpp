@@ -1,128 +1,1301 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "Crc32.h"
 #include "HuffmanCompressor.h"
+#include "ThreadPool.h"
+#include "WorkStealingPool.h"
+
+
+/* Constructors */
+
+HuffmanCompressor::HuffmanCompressor() {
+}
+
+HuffmanCompressor::HuffmanCompressor(const Options& options) :
+    options(options) {
+    if (options.blockSize < MIN_BLOCK_SIZE) {
+        this->options.blockSize = MIN_BLOCK_SIZE;
+    }
+    else if (options.blockSize > MAX_BLOCK_SIZE) {
+        this->options.blockSize = MAX_BLOCK_SIZE;
+    }
+}
+
 
 
 /* Compression Methods */
 
-/* compressFile
-   ------------
-   Write the binary tree key into the compressed file, then step through 
-   the file of data byte by byte, doing the following for each:
+/* compressFile
+   ------------
+   Splits the file into blocks of options.blockSize bytes that are
+   compressed independently:
+
+   1. Read one block for every thread in the pool
+   2. Compress all of them at the same time, each into its own record
+   3. Write the records out in order, remembering where each one went
+
+   Each block counts its own bytes and builds its own codes, so the
+   file is only read once, one batch of blocks at a time. With
+   options.sharedCodes, the whole file is counted up front instead (or
+   with options.sampleChunks, just a sample of it) and the binary tree
+   is built only to find out how long each byte's bit representation
+   should be. Every byte then gets a canonical code of that length, and
+   every block shares those codes. Canonical codes
+   can be rebuilt from their lengths alone, so only the lengths are
+   written into the header instead of the whole tree. Either way, no
+   code is longer than options.maxCodeLength bits.
+
+   After the last block comes an end marker, then an index of where every
+   block is and how big it is, and finally a trailer that says where the
+   index starts. The index lets the decompressor find any block without
+   reading the ones before it.
+
+   Compressed file structure:
+
+   ---------------------------------------------------------------------------------------
+   |             |              |                |          |       |         |          |
+   |  "HUF" + 3  |  Block Size  |  Code Lengths  |  Blocks  |  End  |  Block  |  Trailer |
+   |    (4B)     |     (4B)     |  (1B / <=258B) |  (Any)   |  (1B) |  Index  |   (16B)  |
+   ---------------------------------------------------------------------------------------
+
+   Code Lengths:        NO_SHARED_CODES, or the shared code lengths
+   Block index entry:   | Offset (8B) | Record Size (4B) | Uncompressed Size (4B) |
+   Trailer:             | Index Offset (8B) | Block Count (4B) | "HUF" + 3 (4B) |
+
+   */
+
+bool HuffmanCompressor::compressFile(string infileName, string outfileName, Stats* stats) {
+    chrono::steady_clock::time_point start;
+    if (stats != nullptr) {
+        *stats = Stats();
+        start = chrono::steady_clock::now();
+    }
+
+    ifstream infile;
+    ofstream outfile;
+    infile.open(infileName, ios::binary);
+    if (!infile) {
+        return false;
+    }
+
+    unique_ptr<Codebook> sharedCodebook;
+    if (options.sharedCodes) {
+        FrequencyMap freqMap = countSharedCodes(infileName, threadCount());
+        if (stats != nullptr) {
+            stats->histogramSeconds += secondsSince(start);
+        }
+
+        chrono::steady_clock::time_point buildStart;
+        if (stats != nullptr) {
+            buildStart = chrono::steady_clock::now();
+        }
+        sharedCodebook = buildSharedCodebook(freqMap);
+        if (stats != nullptr) {
+            stats->treeSeconds += secondsSince(buildStart);
+        }
+    }
+
+    outfile.open(outfileName, ios::binary);
+
+    bool succeeded = compressStream(infile, outfile, sharedCodebook.get(), stats) && !infile.bad();
+
+    infile.close();
+    outfile.close();
+    succeeded = succeeded && !outfile.fail();
+
+    if (stats != nullptr) {
+        stats->totalSeconds = secondsSince(start);
+    }
+    return succeeded;
+}
+
+
+/* compressStream
+   --------------
+   Every part of the format is written in order, and the index only
+   points backwards, so compressing never needs to seek at all.
+*/
+
+bool HuffmanCompressor::compressStream(istream& in, ostream& out) {
+    return compressStream(in, out, nullptr);
+}
+
+bool HuffmanCompressor::compressStream(istream& in, ostream& out, const Codebook* sharedCodebook, Stats* stats) {
+    return compressStream(in, sharedCodebook, nullptr,
+        [&](const uint8_t* data, size_t size) {
+            out.write((const char*)data, size);
+            return (bool)out;
+        },
+        stats);
+}
+
+/* The same, for any destination. onRead, if there is one, is shown
+   every block of the input in order, as soon as it has been read. */
+
+bool HuffmanCompressor::compressStream(istream& in, const Codebook* sharedCodebook,
+                                       const function<void(const uint8_t*, size_t)>& onRead,
+                                       const function<bool(const uint8_t*, size_t)>& write, Stats* stats) {
+    unique_ptr<BlockCodec> codec = createCodec(sharedCodebook);
+
+    uint8_t header[MAX_HEADER_SIZE];
+    size_t headerSize = writeHeader(header, sharedCodebook);
+    if (!write(header, headerSize)) {
+        return false;
+    }
+    if (stats != nullptr) {
+        stats->bytesOut += headerSize;
+        stats->writeCalls++;
+    }
+
+    return compressBlocks(*codec, headerSize,
+        [&](vector<uint8_t>& buffer, const uint8_t*& block, size_t& blockSize) {
+            buffer.resize(options.blockSize);
+            in.read((char*)buffer.data(), buffer.size());
+            block = buffer.data();
+            blockSize = (size_t)in.gcount();
+            if (onRead && blockSize > 0) {
+                onRead(block, blockSize);
+            }
+            return blockSize > 0;
+        },
+        write, stats);
+}
+
+
+/* compressBound
+   -------------
+   The most a buffer of size bytes can compress to. A block is never
+   stored any bigger than it already is, so on top of the input this
+   is only the header, every block's record header and index entry,
+   the end marker and the trailer.
+*/
+
+size_t HuffmanCompressor::compressBound(size_t size) const {
+    size_t nBlocks = (size + options.blockSize - 1) / options.blockSize;
+    return MAX_HEADER_SIZE + BlockCodec::maxPayloadSize(size)
+         + nBlocks * (BlockCodec::HEADER_SIZE + BLOCK_ENTRY_SIZE) + 1 + TRAILER_SIZE;
+}
+
+
+/* compressBuffer
+   --------------
+   Compresses in the same way as compressFile, into the same format,
+   but the blocks are taken straight out of the input buffer and the
+   records are copied straight into out. There is nothing to read, so
+   there is no pipeline either, see the second compressBlocks. Returns
+   the compressed size, or 0 if it did not fit in capacity bytes.
+*/
+
+size_t HuffmanCompressor::compressBuffer(const uint8_t* in, size_t size, uint8_t* out, size_t capacity) {
+    unique_ptr<Codebook> sharedCodebook;
+    if (options.sharedCodes) {
+        sharedCodebook = buildSharedCodebook(countSharedCodes(in, size));
+    }
+    unique_ptr<BlockCodec> codec = createCodec(sharedCodebook.get());
+
+    uint8_t header[MAX_HEADER_SIZE];
+    size_t headerSize = writeHeader(header, sharedCodebook.get());
+    if (headerSize > capacity) {
+        return 0;
+    }
+    memcpy(out, header, headerSize);
+
+    size_t written = headerSize;
+
+    bool fits = compressBlocks(*codec, headerSize, in, size,
+        [&](const uint8_t* data, size_t dataSize) {
+            if (dataSize > capacity - written) {
+                return false;
+            }
+            memcpy(out + written, data, dataSize);
+            written += dataSize;
+            return true;
+        });
+
+    return fits ? written : 0;
+}
+
+
+/* Sizes out with compressBound, then trims it to what was used. The
+   vector keeps its capacity, so reusing it saves reallocating. */
+
+size_t HuffmanCompressor::compressBuffer(const uint8_t* in, size_t size, vector<uint8_t>& out) {
+    out.resize(compressBound(size));
+    out.resize(compressBuffer(in, size, out.data(), out.size()));
+    return out.size();
+}
+
+
+/* compressBlocks
+   --------------
+   The part of compression shared by files and streams. nextBlock hands
+   over the next block, either read into the buffer it is given or
+   pointing at memory that already holds it, and returns false once
+   there are none left. Everything that is written goes through write,
+   which returns false to give up.
+
+   Reading, compressing and writing overlap in a pipeline, so the disk
+   is never left idle while blocks are being compressed, or the other
+   way around:
+
+   1. A reader thread gathers blocks into a ring of slots, in order, and
+        hands each one to the pool as soon as it has been read
+   2. The pool compresses any number of them at the same time, each into
+        its slot's record
+   3. This thread writes the records out in order as they finish,
+        remembering where each one went, and frees their slots
+
+   Each slot goes FREE -> COMPRESSING -> COMPRESSED -> FREE, and only one
+   stage ever moves it on from each state, so the stages hand slots to
+   each other through the slot states alone, without any locks. The ring
+   holds two slots per thread, which is enough to keep every stage busy
+   while bounding memory to a few blocks per thread.
+
+   Then the end marker, the block index and the trailer are written.
+   offset is how many bytes were written before the first block. Every
+   offset and the total size are 64-bit, only the number of blocks is
+   not, so the input can be up to MAX_BLOCK_COUNT blocks long.
+
+   With stats, every stage times itself, and each block's own stats are
+   added in by the writer as it frees the block's slot.
+*/
+
+bool HuffmanCompressor::compressBlocks(const BlockCodec& codec, uint64_t offset,
+                                       const function<bool(vector<uint8_t>&, const uint8_t*&, size_t&)>& nextBlock,
+                                       const function<bool(const uint8_t*, size_t)>& write, Stats* stats) const {
+    ThreadPool pool(threadCount());
+    vector<PipelineSlot> slots(2 * pool.size());
+    vector<BlockEntry> index;
+    atomic<bool> stopping(false);
+
+    double readSeconds = 0;
+    uint64_t readCalls = 0;
+    uint64_t counts[Codebook::NUM_SYMBOLS] = { 0 };
+    uint64_t codedBits = 0;
+
+    const function<bool(const uint8_t*, size_t)> timedWrite = [&](const uint8_t* data, size_t size) {
+        if (stats == nullptr) {
+            return write(data, size);
+        }
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        bool written = write(data, size);
+        stats->writeSeconds += secondsSince(start);
+        stats->writeCalls++;
+        stats->bytesOut += size;
+        return written;
+    };
+
+    /* Reader */
+
+    thread reader([&] {
+        for (size_t next = 0; ; next++) {
+            PipelineSlot& slot = slots[next % slots.size()];
+            for (size_t attempt = 0; slot.state.load(memory_order_acquire) != PipelineSlot::FREE; attempt++) {
+                if (stopping) {
+                    return;
+                }
+                backOff(attempt);
+            }
+
+            chrono::steady_clock::time_point start;
+            if (stats != nullptr) {
+                start = chrono::steady_clock::now();
+            }
+            bool read = nextBlock(slot.buffer, slot.block, slot.blockSize);
+            if (stats != nullptr) {
+                readSeconds += secondsSince(start);
+                readCalls++;
+            }
+
+            if (!read) {
+                slot.state.store(PipelineSlot::END, memory_order_release);
+                return;
+            }
+
+            slot.state.store(PipelineSlot::COMPRESSING, memory_order_relaxed);
+            pool.submit([&codec, &slot, stats] {
+                codec.compress(slot.block, slot.blockSize, slot.record, (stats != nullptr) ? &slot.stats : nullptr);
+                slot.state.store(PipelineSlot::COMPRESSED, memory_order_release);
+            });
+        }
+    });
+
+    /* Writer */
+
+    bool written = true;
+    for (size_t next = 0; written; next++) {
+        PipelineSlot& slot = slots[next % slots.size()];
+        uint8_t state;
+        for (size_t attempt = 0; (state = slot.state.load(memory_order_acquire)) < PipelineSlot::COMPRESSED; attempt++) {
+            backOff(attempt);
+        }
+        if (state == PipelineSlot::END) {
+            break;
+        }
+
+        if (index.size() == MAX_BLOCK_COUNT || !timedWrite(slot.record.data(), slot.record.size())) {
+            written = false;
+            stopping = true;
+            break;
+        }
+        index.push_back({ offset, (uint32_t)slot.record.size(), (uint32_t)slot.blockSize });
+        offset += slot.record.size();
+
+        if (stats != nullptr) {
+            const BlockCodec::Stats& blockStats = slot.stats;
+            for (size_t symbol = 0; symbol < Codebook::NUM_SYMBOLS; symbol++) {
+                counts[symbol] += blockStats.counts[symbol];
+            }
+            codedBits += blockStats.codedBits;
+            stats->maxCodeLength = max(stats->maxCodeLength, blockStats.maxCodeLength);
+            stats->histogramSeconds += blockStats.countSeconds;
+            stats->treeSeconds += blockStats.buildSeconds;
+            stats->codingSeconds += blockStats.codingSeconds;
+            stats->bytesIn += slot.blockSize;
+            stats->nBlocks++;
+        }
+        slot.state.store(PipelineSlot::FREE, memory_order_release);
+    }
+
+    reader.join();
+    pool.wait();
+
+    if (stats != nullptr) {
+        stats->readSeconds += readSeconds;
+        stats->readCalls += readCalls;
+        stats->distinctSymbols = (uint32_t)count_if(counts, counts + Codebook::NUM_SYMBOLS,
+                                                    [](uint64_t count) { return count > 0; });
+        stats->averageCodeLength = (stats->bytesIn > 0) ? (double)codedBits / stats->bytesIn : 0;
+    }
+    if (!written) {
+        return false;
+    }
+
+    return writeFooter(index, offset, timedWrite);
+}
+
+
+/* The same, for blocks that are already in memory. Nothing has to be
+   read, so a batch of blocks, one for each thread, is compressed at a
+   time and then written out in order. The pool is never bigger than
+   the number of blocks, and a single block is compressed right here
+   without starting any threads at all. */
+
+bool HuffmanCompressor::compressBlocks(const BlockCodec& codec, uint64_t offset, const uint8_t* in, size_t size,
+                                       const function<bool(const uint8_t*, size_t)>& write) const {
+    size_t nBlocks = (size + options.blockSize - 1) / options.blockSize;
+    if (nBlocks > MAX_BLOCK_COUNT) {
+        return false;
+    }
+
+    size_t nThreads = min(threadCount(), nBlocks);
+    unique_ptr<ThreadPool> pool;
+    if (nThreads > 1) {
+        pool.reset(new ThreadPool(nThreads));
+    }
+
+    vector<vector<uint8_t>> records(max<size_t>(nThreads, 1));
+    vector<BlockEntry> index;
+    index.reserve(nBlocks);
+
+    const auto blockSizeOf = [&](size_t block) {
+        return min<size_t>(size - block * options.blockSize, options.blockSize);
+    };
+
+    for (size_t first = 0; first < nBlocks; first += records.size()) {
+        size_t batchSize = min(records.size(), nBlocks - first);
+
+        for (size_t i = 0; i < batchSize; i++) {
+            const uint8_t* block = in + (first + i) * options.blockSize;
+            size_t blockSize = blockSizeOf(first + i);
+            vector<uint8_t>& record = records[i];
+            if (pool == nullptr) {
+                codec.compress(block, blockSize, record);
+            }
+            else {
+                pool->submit([&codec, block, blockSize, &record] {
+                    codec.compress(block, blockSize, record);
+                });
+            }
+        }
+        if (pool != nullptr) {
+            pool->wait();
+        }
+
+        for (size_t i = 0; i < batchSize; i++) {
+            const vector<uint8_t>& record = records[i];
+            if (!write(record.data(), record.size())) {
+                return false;
+            }
+            index.push_back({ offset, (uint32_t)record.size(), (uint32_t)blockSizeOf(first + i) });
+            offset += record.size();
+        }
+    }
+
+    return writeFooter(index, offset, write);
+}
+
+
+/* writeFooter
+   -----------
+   Writes the end marker, the block index and the trailer after the
+   last block record, which ends at offset.
+*/
+
+bool HuffmanCompressor::writeFooter(const vector<BlockEntry>& index, uint64_t offset,
+                                    const function<bool(const uint8_t*, size_t)>& write) const {
+    vector<uint8_t> footer(1 + index.size() * BLOCK_ENTRY_SIZE + TRAILER_SIZE);
+    footer[0] = BlockCodec::END_OF_BLOCKS;
+    offset++;
+
+    uint8_t* entry = &footer[1];
+    for (const BlockEntry& block : index) {
+        BlockCodec::putUInt64(entry, block.offset);
+        BlockCodec::putUInt32(entry + 8, block.recordSize);
+        BlockCodec::putUInt32(entry + 12, block.uncompressedSize);
+        entry += BLOCK_ENTRY_SIZE;
+    }
+    BlockCodec::putUInt64(entry, offset);
+    BlockCodec::putUInt32(entry + 8, (uint32_t)index.size());
+    BlockCodec::putUInt32(entry + 12, MAGIC | ((uint32_t)BLOCK_VERSION << 24));
+    return write(footer.data(), footer.size());
+}
+
+
+/* backOff
+   -------
+   Waits a little before a pipeline stage checks a slot again. Yields
+   at first, since slots usually come free quickly, then sleeps so a
+   stage that is waiting on the disk does not hold up a whole core.
+*/
+
+void HuffmanCompressor::backOff(size_t attempt) {
+    if (attempt < 64) {
+        this_thread::yield();
+    }
+    else {
+        this_thread::sleep_for(chrono::microseconds(100));
+    }
+}
+
+
+/* compressBatch
+   -------------
+   Hands the files out to a WorkStealingPool. Each thread builds its
+   codec and buffers on its first file and keeps them for the rest, so
+   a small file costs little more than reading and coding its bytes.
+   Per-file pipelines would only add threads that fight the pool's, so
+   every file is compressed serially by compressBatchFile.
+*/
+
+HuffmanCompressor::BatchResult HuffmanCompressor::compressBatch(const vector<BatchFile>& files) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    WorkStealingPool pool(min(threadCount(), max<size_t>(files.size(), 1)));
+    vector<BatchScratch> scratches(pool.size());
+
+    pool.run(files.size(), [&](size_t worker, size_t i) {
+        BatchScratch& scratch = scratches[worker];
+        if (!compressBatchFile(files[i], scratch)) {
+            scratch.failed.push_back(i);
+        }
+    });
+
+    BatchResult result;
+    result.nFiles = files.size();
+    for (const BatchScratch& scratch : scratches) {
+        result.bytesIn += scratch.bytesIn;
+        result.bytesOut += scratch.bytesOut;
+        result.failed.insert(result.failed.end(), scratch.failed.begin(), scratch.failed.end());
+    }
+    sort(result.failed.begin(), result.failed.end());
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+/* Input bytes per second, in megabytes */
+
+double HuffmanCompressor::BatchResult::megabytesPerSecond() const {
+    return (seconds > 0) ? bytesIn / seconds / 1e6 : 0;
+}
+
+
+/* Stats::write
+   ------------
+   Writes every stat on a line of its own, as its name and value, for
+   passing on to a metrics system. Throughput is in megabytes of input
+   per second.
+*/
+
+void HuffmanCompressor::Stats::write(ostream& out) const {
+    double megabytesPerSecond = (totalSeconds > 0) ? bytesIn / totalSeconds / 1e6 : 0;
+
+    out << "bytes_in " << bytesIn << "\n"
+        << "bytes_out " << bytesOut << "\n"
+        << "blocks " << nBlocks << "\n"
+        << "total_seconds " << totalSeconds << "\n"
+        << "histogram_seconds " << histogramSeconds << "\n"
+        << "tree_seconds " << treeSeconds << "\n"
+        << "coding_seconds " << codingSeconds << "\n"
+        << "read_seconds " << readSeconds << "\n"
+        << "write_seconds " << writeSeconds << "\n"
+        << "input_megabytes_per_second " << megabytesPerSecond << "\n"
+        << "distinct_symbols " << distinctSymbols << "\n"
+        << "max_code_length " << maxCodeLength << "\n"
+        << "average_code_length " << averageCodeLength << "\n"
+        << "read_calls " << readCalls << "\n"
+        << "write_calls " << writeCalls << "\n";
+}
+
+
+/* compressBatchFile
+   -----------------
+   Compresses one file of a batch on this thread alone, block by block,
+   with the thread's scratch, into the same format as compressFile.
+   With options.sharedCodes the file gets its own codec, since its codes
+   come from its own bytes. Returns false if the input could not be
+   read or the output could not be written.
+*/
+
+bool HuffmanCompressor::compressBatchFile(const BatchFile& file, BatchScratch& scratch) const {
+    ifstream infile(file.input, ios::binary);
+    if (!infile) {
+        return false;
+    }
+
+    unique_ptr<Codebook> sharedCodebook;
+    unique_ptr<BlockCodec> fileCodec;
+    if (options.sharedCodes) {
+        sharedCodebook = buildSharedCodebook(countSharedCodes(file.input, 1));
+        fileCodec = createCodec(sharedCodebook.get());
+    }
+    else if (!scratch.codec) {
+        scratch.codec = createCodec(nullptr);
+    }
+    const BlockCodec& codec = fileCodec ? *fileCodec : *scratch.codec;
+
+    ofstream outfile(file.output, ios::binary);
+    uint8_t header[MAX_HEADER_SIZE];
+    size_t headerSize = writeHeader(header, sharedCodebook.get());
+    outfile.write((const char*)header, headerSize);
+
+    uint64_t offset = headerSize;
+    uint64_t bytesIn = 0;
+    scratch.index.clear();
+    scratch.block.resize(options.blockSize);
+
+    while (infile && outfile) {
+        infile.read((char*)scratch.block.data(), scratch.block.size());
+        size_t blockSize = (size_t)infile.gcount();
+        if (blockSize == 0) {
+            break;
+        }
+        if (scratch.index.size() == MAX_BLOCK_COUNT) {
+            return false;
+        }
+
+        codec.compress(scratch.block.data(), blockSize, scratch.record);
+        outfile.write((const char*)scratch.record.data(), scratch.record.size());
+        scratch.index.push_back({ offset, (uint32_t)scratch.record.size(), (uint32_t)blockSize });
+        offset += scratch.record.size();
+        bytesIn += blockSize;
+    }
+
+    uint64_t bytesOut = offset + 1 + scratch.index.size() * BLOCK_ENTRY_SIZE + TRAILER_SIZE;
+    bool written = outfile && writeFooter(scratch.index, offset,
+        [&](const uint8_t* data, size_t size) {
+            outfile.write((const char*)data, size);
+            outfile.flush();
+            return (bool)outfile;
+        });
+    if (!written) {
+        return false;
+    }
+
+    scratch.bytesIn += bytesIn;
+    scratch.bytesOut += bytesOut;
+    return true;
+}
+
+
+/* buildSharedCodebook
+   -------------------
+   Turns the counts of a whole file into the codes every block shares.
+*/
+
+unique_ptr<Codebook> HuffmanCompressor::buildSharedCodebook(const FrequencyMap& freqMap) const {
+    uint8_t lengths[Codebook::NUM_SYMBOLS];
+    Codebook::buildLengths(freqMap, options.maxCodeLength, lengths);
+    return unique_ptr<Codebook>(new Codebook(lengths));
+}
+
+
+/* countSharedCodes
+   ----------------
+   Counts the bytes the shared codes are built from: all of them, or
+   with options.sampleChunks, just a sample.
+*/
+
+FrequencyMap HuffmanCompressor::countSharedCodes(const string& filename, size_t nThreads) const {
+    if (options.sampleChunks > 0) {
+        return FrequencyMap::sample(filename, options.sampleChunks);
+    }
+    return FrequencyMap(filename, nThreads);
+}
+
+FrequencyMap HuffmanCompressor::countSharedCodes(const uint8_t* data, size_t size) const {
+    if (options.sampleChunks > 0) {
+        return FrequencyMap::sample(data, size, options.sampleChunks);
+    }
+    return FrequencyMap(data, size, threadCount());
+}
+
+
+/* createCodec
+   -----------
+   Returns a codec that codes with sharedCodebook, or that gives each
+   block its own codes if there is none.
+*/
+
+unique_ptr<BlockCodec> HuffmanCompressor::createCodec(const Codebook* sharedCodebook) const {
+    if (sharedCodebook != nullptr) {
+        return unique_ptr<BlockCodec>(new BlockCodec(*sharedCodebook, options.splitStreams, options.contextCodes, options.lzLevel));
+    }
+    return unique_ptr<BlockCodec>(new BlockCodec(options.maxCodeLength, options.splitStreams, options.contextCodes, options.lzLevel));
+}
+
+
+
+/* Decompression Methods */
+
+/* DecompressFile
+   --------------
+   Checks which version of the format the file was written in and
+   hands it off to the matching decompressor. Files written before
+   the format was versioned start straight away with the tree.
+*/
+
+bool HuffmanCompressor::decompressFile(string compressedFile, string outputFile, Stats* stats) {
+    chrono::steady_clock::time_point start;
+    if (stats != nullptr) {
+        *stats = Stats();
+        start = chrono::steady_clock::now();
+    }
+
+    ifstream infile;
+    ofstream outfile;
+
+    infile.open(compressedFile, ios::binary);
+    outfile.open(outputFile, ios::binary);
+
+    bool succeeded = false;
+    uint8_t version = readVersion(infile);
+    if (version == LEGACY_VERSION) {
+        succeeded = decompressLegacy(infile, outfile);
+    }
+    else if (version == CANONICAL_VERSION) {
+        succeeded = decompressCanonical(infile, outfile);
+    }
+    else if (version == BLOCK_VERSION) {
+        succeeded = decompressBlocks(infile, outfile, compressedFile, outputFile, stats);
+    }
+
+    infile.close();
+    outfile.close();
+    succeeded = succeeded && !outfile.fail();
+
+    if (stats != nullptr) {
+        stats->bytesIn = fileSize(compressedFile);
+        stats->bytesOut = fileSize(outputFile);
+        stats->totalSeconds = secondsSince(start);
+    }
+    return succeeded;
+}
+
+
+/* decompressedSize
+   ----------------
+   Finds how big a compressed buffer will be once it is decompressed,
+   from its block index. Returns false if it is not a valid buffer.
+*/
+
+bool HuffmanCompressor::decompressedSize(const uint8_t* in, size_t size, uint64_t& outSize) const {
+    vector<BlockEntry> index;
+    if (readVersion(in, size) != BLOCK_VERSION || !readBlockIndex(in, size, index)) {
+        return false;
+    }
+
+    vector<uint64_t> outputOffsets;
+    outSize = findOutputOffsets(index, outputOffsets);
+    return true;
+}
+
+
+/* decompressBuffer
+   ----------------
+   Decompresses a buffer written by compressBuffer, or the contents of a
+   file written by compressFile, straight into out. Every block record is
+   already in memory, so the blocks are simply decoded in parallel, each
+   into its own place in out. As in compressBlocks, a single block, or a
+   single thread, decodes right here without starting any threads at
+   all. Returns false if the buffer is corrupt or
+   its contents do not fit in capacity bytes.
+*/
+
+bool HuffmanCompressor::decompressBuffer(const uint8_t* in, size_t size, uint8_t* out, size_t capacity, size_t& outSize) {
+    const size_t headerSize = 4 + 4;
+
+    unique_ptr<Codebook> sharedCodebook;
+    unique_ptr<BlockCodec> codec;
+    vector<BlockEntry> index;
+    if (readVersion(in, size) != BLOCK_VERSION || size < headerSize
+        || !readSharedCodes(in + headerSize, size - headerSize, sharedCodebook, codec)
+        || !readBlockIndex(in, size, index)) {
+        return false;
+    }
+
+    vector<uint64_t> outputOffsets;
+    uint64_t outputSize = findOutputOffsets(index, outputOffsets);
+    if (outputSize > capacity) {
+        return false;
+    }
+
+    size_t nThreads = min(threadCount(), index.size());
+    unique_ptr<ThreadPool> pool;
+    if (nThreads > 1) {
+        pool.reset(new ThreadPool(nThreads));
+    }
+    atomic<bool> failed(false);
+
+    const auto decompressBlock = [&](size_t i) {
+        const BlockEntry& entry = index[i];
+        if (failed || entry.offset > size || entry.recordSize > size - entry.offset
+            || !codec->decompress(in + entry.offset, entry.recordSize, out + outputOffsets[i], entry.uncompressedSize)) {
+            failed = true;
+        }
+    };
+
+    for (size_t i = 0; i < index.size(); i++) {
+        if (pool == nullptr) {
+            decompressBlock(i);
+        }
+        else {
+            pool->submit([&decompressBlock, i] {
+                decompressBlock(i);
+            });
+        }
+    }
+    if (pool != nullptr) {
+        pool->wait();
+    }
+
+    outSize = (size_t)outputSize;
+    return !failed;
+}
+
+
+/* Sizes out to fit the decompressed data and decompresses into it */
+
+bool HuffmanCompressor::decompressBuffer(const uint8_t* in, size_t size, vector<uint8_t>& out) {
+    uint64_t outSize;
+    if (!decompressedSize(in, size, outSize) || outSize > out.max_size()) {
+        return false;
+    }
+    out.resize((size_t)outSize);
+
+    size_t written;
+    return decompressBuffer(in, size, out.data(), out.size(), written);
+}
+
+
+/* decompressStream
+   ----------------
+   Reads the header, then a batch of block records (one for every thread
+   in the pool), decompresses them all at the same time and writes them
+   out in order, until the end marker. Every record says how big it is
+   up front, so nothing after it is needed to read it. Finally the index
+   and trailer are read past, so in is left at the very end of the data.
+
+   A record whose sizes are bigger than the block size in the header
+   allows is corrupt, which keeps memory bounded by a few blocks.
+*/
+
+bool HuffmanCompressor::decompressStream(istream& in, ostream& out) {
+    return decompressStream(in,
+        [&](const uint8_t* data, size_t size) {
+            out.write((const char*)data, size);
+            return (bool)out;
+        });
+}
+
+/* The same, for any destination */
+
+bool HuffmanCompressor::decompressStream(istream& in, const function<bool(const uint8_t*, size_t)>& write) {
+    uint8_t header[MAX_HEADER_SIZE];
+    in.read((char*)header, 4 + 4 + 1);
+    if (in.gcount() != 4 + 4 + 1 || readVersion(header, 4) != BLOCK_VERSION) {
+        return false;
+    }
+    uint32_t blockSize = BlockCodec::getUInt32(header + 4);
+
+    /* Shared codes, which may only be a single NO_SHARED_CODES byte */
+
+    size_t codesSize = 1;
+    if (header[8] != NO_SHARED_CODES) {
+        in.read((char*)header + 9, 1);
+        codesSize = Codebook::lengthsSize(header + 8);
+        if (codesSize < 2 || codesSize > Codebook::MAX_LENGTHS_SIZE) {
+            return false;
+        }
+        in.read((char*)header + 10, codesSize - 2);
+    }
+
+    unique_ptr<Codebook> sharedCodebook;
+    unique_ptr<BlockCodec> codec;
+    if (!in || !readSharedCodes(header + 8, codesSize, sharedCodebook, codec)) {
+        return false;
+    }
+
+    /* Blocks, one batch per round of the thread pool */
+
+    ThreadPool pool(threadCount());
+    vector<vector<uint8_t>> records(pool.size());
+    vector<vector<uint8_t>> blocks(pool.size());
+    atomic<bool> failed(false);
+    uint64_t nBlocksRead = 0;
+    bool endOfBlocks = false;
+
+    while (!endOfBlocks) {
+        size_t nBlocks = 0;
+        while (nBlocks < pool.size()) {
+            if (!readRecord(in, blockSize, records[nBlocks])) {
+                return false;
+            }
+            if (records[nBlocks][0] == BlockCodec::END_OF_BLOCKS) {
+                endOfBlocks = true;
+                break;
+            }
+            nBlocks++;
+        }
+
+        for (size_t i = 0; i < nBlocks; i++) {
+            pool.submit([&, i] {
+                const vector<uint8_t>& record = records[i];
+                blocks[i].resize(BlockCodec::getUInt32(&record[1]));
+                if (!codec->decompress(record.data(), record.size(), blocks[i].data(), blocks[i].size())) {
+                    failed = true;
+                }
+            });
+        }
+        pool.wait();
+
+        if (failed) {
+            return false;
+        }
+        for (size_t i = 0; i < nBlocks; i++) {
+            if (!write(blocks[i].data(), blocks[i].size())) {
+                return false;
+            }
+        }
+        nBlocksRead += nBlocks;
+    }
+
+    /* Step past the index and check the trailer */
+
+    uint8_t trailer[TRAILER_SIZE];
+    in.ignore((streamsize)(nBlocksRead * BLOCK_ENTRY_SIZE));
+    in.read((char*)trailer, sizeof(trailer));
+
+    uint64_t indexOffset;
+    uint32_t blockCount;
+    return in.gcount() == TRAILER_SIZE && readTrailer(trailer, indexOffset, blockCount)
+        && blockCount == nBlocksRead;
+}
+
+
+/* decompressRange
+   ---------------
+   Finds the blocks that cover the range from the block index, by a
+   binary search of their output offsets, and decompresses just those.
+   Only the first and last block can stick out past the range, so only
+   they are trimmed as they are copied into out:
+
+        block:  |   first   |     ...     |    last    |
+        range:        |------------------------|
+
+   readBlockFile has already checked every entry of the index against
+   the block size and the file, so no record or block sized from it
+   can be bigger than one block.
+*/
+
+bool HuffmanCompressor::decompressRange(string compressedFile, uint64_t offset, uint64_t length, vector<uint8_t>& out) {
+    out.clear();
+
+    ifstream infile(compressedFile, ios::binary);
+    unique_ptr<Codebook> sharedCodebook;
+    unique_ptr<BlockCodec> codec;
+    vector<BlockEntry> index;
+    if (readVersion(infile) != BLOCK_VERSION || !readBlockFile(infile, sharedCodebook, codec, index)) {
+        return false;
+    }
+
+    vector<uint64_t> outputOffsets;
+    uint64_t outputSize = findOutputOffsets(index, outputOffsets);
+    if (offset > outputSize) {
+        return false;
+    }
+    uint64_t end = offset + min(length, outputSize - offset);
+    if (end == offset) {
+        return true;
+    }
+
+    size_t first = upper_bound(outputOffsets.begin(), outputOffsets.end(), offset) - outputOffsets.begin() - 1;
+    size_t last = lower_bound(outputOffsets.begin(), outputOffsets.end(), end) - outputOffsets.begin();
+    out.resize((size_t)(end - offset));
+
+    vector<uint8_t> record;
+    vector<uint8_t> block;
+
+    for (size_t i = first; i < last; i++) {
+        const BlockEntry& entry = index[i];
+        record.resize(entry.recordSize);
+        block.resize(entry.uncompressedSize);
+
+        infile.seekg((streamoff)entry.offset);
+        infile.read((char*)record.data(), record.size());
+        if ((size_t)infile.gcount() != record.size()
+            || !codec->decompress(record.data(), record.size(), block.data(), block.size())) {
+            out.clear();
+            return false;
+        }
+
+        uint64_t blockStart = max(outputOffsets[i], offset);
+        uint64_t blockEnd = min(outputOffsets[i] + entry.uncompressedSize, end);
+        memcpy(out.data() + (blockStart - offset), block.data() + (blockStart - outputOffsets[i]),
+               (size_t)(blockEnd - blockStart));
+    }
+    return true;
+}
+
+
+/* compressMessage
+   ---------------
+   A message is its dictionary's ID and its size, as variable length
+   integers, then its coded bits. The size of the coded bits is added up from the code lengths
+   first, so a message that will not fit is turned down before any of
+   it is written. The encoder stores 8 bytes at a time, so a message
+   that fits but leaves no room for that is coded aside and copied in.
+*/
+
+size_t HuffmanCompressor::compressMessage(const Dictionary& dictionary, const uint8_t* in, size_t size,
+                                          uint8_t* out, size_t capacity) const {
+    const Codebook& codebook = dictionary.getCodebook();
+    if (size > 0xFFFFFFFF) {
+        return 0;
+    }
+
+    uint64_t nBits = 0;
+    for (size_t i = 0; i < size; i++) {
+        nBits += codebook.getCode(in[i]).nBits;
+    }
+    size_t idBytes = BlockCodec::varUIntSize(dictionary.getId());
+    size_t sizeBytes = idBytes + BlockCodec::varUIntSize(size);
+    size_t messageSize = sizeBytes + (size_t)((nBits + 7) / 8);
+    if (messageSize > capacity) {
+        return 0;
+    }
+
+    BlockCodec::putVarUInt(out, dictionary.getId());
+    BlockCodec::putVarUInt(out + idBytes, (uint32_t)size);
+    if (messageSize + 8 <= capacity) {
+        BlockCodec::encode(codebook, in, size, out + sizeBytes);
+    }
+    else {
+        vector<uint8_t> bits(messageSize - sizeBytes + 8);
+        BlockCodec::encode(codebook, in, size, bits.data());
+        memcpy(out + sizeBytes, bits.data(), messageSize - sizeBytes);
+    }
+    return messageSize;
+}
 
-   1. Find the bit representation of the byte as given by the binary tree
-   2. Fill as much of an 8-bit mask as we can with those bits, then get a new mask if we need to
-   3. If necessary, fill mask 2 with some of the bits we could not fit into mask 1
+/* Sizes out for the longest codes plus the encoder's slack, then trims
+   it to what was used. */
 
-   Once the 8-bit mask is full, it is ready to be pushed to the compressed file.
-   At the end of the file there are anywhere between 0-7 trailing 0's. If the last mask 
-   ended with only one of the bits filled, the remaining 7 bits are trailing 0's.
-   They could be misread by the decompresser as another character. Thus we need to include
-   the number of trailing 0's as the last byte of data in the file.
+size_t HuffmanCompressor::compressMessage(const Dictionary& dictionary, const uint8_t* in, size_t size,
+                                          vector<uint8_t>& out) const {
+    uint64_t maxBits = (uint64_t)size * dictionary.getCodebook().maxLength();
+    out.resize(BlockCodec::varUIntSize(dictionary.getId()) + BlockCodec::varUIntSize(size) + (size_t)((maxBits + 7) / 8) + 8);
+    out.resize(compressMessage(dictionary, in, size, out.data(), out.size()));
+    return out.size();
+}
 
-   Compressed file structure:
 
-   ------------------------------------------------------------------------------------------
-   |               |            |                   |                  |                    |
-   |  Binary Tree  |  Sentinel  |  Compressed Data  |  Trailing Zeros  |  # Trailing Zeros  |
-   |    (<1KB)     |    (1B)    |    (Any Size)     |      (<1B)       |        (1B)        |
-   ------------------------------------------------------------------------------------------
+/* decompressMessage
+   -----------------
+   Turns down a message coded with some other dictionary, then reads
+   the size and decodes that many bytes with the dictionary's decode
+   table, which was built when the dictionary was.
+*/
 
-   */
+bool HuffmanCompressor::decompressMessage(const Dictionary& dictionary, const uint8_t* in, size_t size,
+                                          vector<uint8_t>& out) const {
+    out.clear();
 
-void HuffmanCompressor::compressFile(string infileName, string outfileName) {
-    FrequencyMap freqMap(infileName);
-    Tree freqTree(freqMap);
+    uint32_t id = 0;
+    size_t idBytes = BlockCodec::getVarUInt(in, size, id);
+    if (idBytes == 0 || id != dictionary.getId()) {
+        return false;
+    }
 
-    ifstream infile;
-    ofstream outfile;
-    infile.open(infileName, ios::binary);
-    outfile.open(outfileName, ios::binary);
+    uint32_t messageSize = 0;
+    size_t sizeBytes = BlockCodec::getVarUInt(in + idBytes, size - idBytes, messageSize);
+    if (sizeBytes == 0) {
+        return false;
+    }
+    sizeBytes += idBytes;
+    if (messageSize > (uint64_t)(size - sizeBytes) * 8) {
+        return false;
+    }
 
-    freqTree.writeTo(outfile);
+    out.resize(messageSize);
+    if (!BlockCodec::decode(dictionary.getDecodeTable(), in + sizeBytes, size - sizeBytes, out.data(), out.size())) {
+        out.clear();
+        return false;
+    }
+    return true;
+}
 
-    /* Compression Variables */
 
-    uint8_t mask = 0b0;
-    uint8_t filledBits = 0;
+/* readRecord
+   ----------
+   Reads the next block record, or the lone end marker, into record.
+   Returns false if it is cut off or bigger than a block can be.
+*/
 
-    char ch;
-    uint8_t byte;
+bool HuffmanCompressor::readRecord(istream& in, uint32_t blockSize, vector<uint8_t>& record) const {
+    record.resize(BlockCodec::HEADER_SIZE);
+    in.read((char*)record.data(), 1);
+    if (in.gcount() != 1) {
+        return false;
+    }
+    if (record[0] == BlockCodec::END_OF_BLOCKS) {
+        record.resize(1);
+        return true;
+    }
 
-    /* Outer Loop for receiving bytes from the uncompressed file */
+    in.read((char*)record.data() + 1, BlockCodec::HEADER_SIZE - 1);
+    BlockCodec::Header header;
+    if ((size_t)in.gcount() != BlockCodec::HEADER_SIZE - 1
+        || !BlockCodec::readHeader(record.data(), record.size(), header)
+        || header.uncompressedSize > blockSize
+        || header.payloadSize > BlockCodec::maxPayloadSize(header.uncompressedSize)) {
+        return false;
+    }
 
-    while (infile.get(ch)) {
-        byte = (uint8_t)ch;
+    record.resize(BlockCodec::HEADER_SIZE + header.payloadSize);
+    in.read((char*)record.data() + BlockCodec::HEADER_SIZE, header.payloadSize);
+    return (size_t)in.gcount() == header.payloadSize;
+}
 
-        /* Get the bit rep for the byte as an int and and its length in bits */
 
-        Tree::bitRep bitRepPair = freqTree.findBitRepOf(byte);
-        uint32_t bitRep = bitRepPair.bits;
-        uint32_t nBits = bitRepPair.nBits;
+/* decompressBlocks
+   ----------------
+   Rebuilds the shared codes from the header, if the blocks do not
+   carry their own, then uses the block index at the end of the file
+   to find every block record. Since the index
+   also says how big every block is once decompressed, we know where
+   each one belongs in the output before decoding any of them:
 
-        /* Inner loop for filling 8 bit masks */
+   1. Add up the uncompressed sizes to find every block's output offset
+   2. Grow the output file to its final size
+   3. Give each thread a run of neighbouring blocks, which it reads with its
+        own handle on the compressed file and writes straight to their final
+        place through its own handle on the output file
 
-        while (true) {
+   Returns false if the index or any block is corrupt, or the output
+   could not be written.
 
-            if (filledBits == sizeof(mask) * 8) {
-                outfile << mask;
-                mask = 0;
-                filledBits = 0;
-            }
+   Compressed file structure:
+
+   ---------------------------------------------------------------------------------------
+   |             |              |                |          |       |         |          |
+   |  "HUF" + 3  |  Block Size  |  Code Lengths  |  Blocks  |  End  |  Block  |  Trailer |
+   |    (4B)     |     (4B)     |  (1B / <=258B) |  (Any)   |  (1B) |  Index  |   (16B)  |
+   ---------------------------------------------------------------------------------------
+*/
 
-            uint8_t unfilledBits = sizeof(mask) * 8 - filledBits;
+bool HuffmanCompressor::decompressBlocks(ifstream& infile, ofstream& outfile,
+                                         const string& compressedFile, const string& outputFile, Stats* stats) const {
+    chrono::steady_clock::time_point start;
+    if (stats != nullptr) {
+        start = chrono::steady_clock::now();
+    }
 
-            if (nBits > unfilledBits) {
+    unique_ptr<Codebook> sharedCodebook;
+    unique_ptr<BlockCodec> codec;
+    vector<BlockEntry> index;
+    if (!readBlockFile(infile, sharedCodebook, codec, index)) {
+        return false;
+    }
+    if (stats != nullptr) {
+        stats->treeSeconds += secondsSince(start);
+    }
 
-                /* Transfer all the bits we can to the current mask,
-                   and keep track of how many are left. */
+    /* Find where every block goes and presize the output */
 
-                uint32_t tempBitRep;
-                tempBitRep = bitRep >> (nBits - unfilledBits);
+    vector<uint64_t> outputOffsets;
+    uint64_t outputSize = findOutputOffsets(index, outputOffsets);
 
-                mask = mask | (uint8_t)tempBitRep;
-                filledBits += unfilledBits;
-                nBits -= unfilledBits;
+    if (outputSize > 0) {
+        outfile.seekp((streamoff)(outputSize - 1));
+        outfile.put(0);
+    }
+    outfile.flush();
+    if (!outfile) {
+        return false;
+    }
 
-                bitRep = bitRep << (sizeof(bitRep) * 8 - nBits);
-                bitRep = bitRep >> (sizeof(bitRep) * 8 - nBits);
+    /* Decompress runs of blocks in parallel */
+
+    size_t nRuns = min(threadCount(), index.size());
+    ThreadPool pool(nRuns);
+    atomic<bool> failed(false);
+    vector<Stats> runStats((stats != nullptr) ? nRuns : 0);
+
+    for (size_t run = 0; run < nRuns; run++) {
+        size_t first = index.size() * run / nRuns;
+        size_t last = index.size() * (run + 1) / nRuns;
+        Stats* runStat = (stats != nullptr) ? &runStats[run] : nullptr;
+        pool.submit([&, first, last, runStat] {
+            if (!decompressBlockRun(compressedFile, outputFile, *codec, index, outputOffsets[first], first, last,
+                                    failed, runStat)) {
+                failed = true;
             }
-            else if (nBits <= unfilledBits) {
+        });
+    }
+    pool.wait();
+
+    for (const Stats& runStat : runStats) {
+        stats->nBlocks += runStat.nBlocks;
+        stats->codingSeconds += runStat.codingSeconds;
+        stats->readSeconds += runStat.readSeconds;
+        stats->writeSeconds += runStat.writeSeconds;
+        stats->readCalls += runStat.readCalls;
+        stats->writeCalls += runStat.writeCalls;
+    }
+    return !failed;
+}
 
-                /* Transfer all bits to the current mask */
 
-                uint8_t tempBitRep = bitRep << (unfilledBits - nBits);
-                mask = mask | tempBitRep;
-                filledBits += nBits;
-                break; //We've filled all we can with the current byte
-            }
+/* decompressBlockRun
+   ------------------
+   Decompresses blocks [first, last) of the index, which sit next to each
+   other in the output starting at outputOffset. Stops early if another
+   run has already failed. Returns false if a block is corrupt or could
+   not be written. Times
+   each step into stats, if given.
+*/
+
+bool HuffmanCompressor::decompressBlockRun(const string& compressedFile, const string& outputFile,
+                                           const BlockCodec& codec, const vector<BlockEntry>& index,
+                                           uint64_t outputOffset, size_t first, size_t last,
+                                           const atomic<bool>& failed, Stats* stats) const {
+    ifstream infile(compressedFile, ios::binary);
+    fstream outfile(outputFile, ios::in | ios::out | ios::binary);
+    outfile.seekp((streamoff)outputOffset);
+
+    vector<uint8_t> record;
+    vector<uint8_t> block;
+    chrono::steady_clock::time_point start;
+
+    for (size_t i = first; i < last && !failed; i++) {
+        const BlockEntry& entry = index[i];
+        record.resize(entry.recordSize);
+        block.resize(entry.uncompressedSize);
+
+        if (stats != nullptr) {
+            start = chrono::steady_clock::now();
+        }
+        infile.seekg((streamoff)entry.offset);
+        infile.read((char*)record.data(), record.size());
+        if (stats != nullptr) {
+            stats->readSeconds += secondsSince(start);
+            stats->readCalls++;
+            start = chrono::steady_clock::now();
+        }
+
+        if (!codec.decompress(record.data(), (size_t)infile.gcount(), block.data(), block.size())) {
+            return false;
+        }
+        if (stats != nullptr) {
+            stats->codingSeconds += secondsSince(start);
+            start = chrono::steady_clock::now();
+        }
+
+        outfile.write((const char*)block.data(), block.size());
+        if (stats != nullptr) {
+            stats->writeSeconds += secondsSince(start);
+            stats->writeCalls++;
+            stats->nBlocks++;
         }
     }
+    return (bool)outfile;
+}
 
-    /* Put the very last mask into the outfile, as well as the trailing zeros footer */
 
-    outfile << mask;
-    uint8_t trailingZeros = 8 - filledBits;
-    outfile << trailingZeros;
+/* decompressCanonical
+   -------------------
+   Unpacks the code lengths, rebuilds the canonical codes from them and
+   turns those into a DecodeTable, which resolves one or two whole
+   symbols for every 11 bits it looks at. No tree is built at all.
+   The process is as follows:
 
-    infile.close();
-    outfile.close();
-}
+   1. Work out how many bits of compressed data there are from the file
+        length and the number of trailing zeros, which was stored in the last byte.
+   2. Read the compressed data in large chunks through a 64-bit BitReader.
+   3. Decode as many symbols as fit in the output buffer, then write it out in one go.
+   4. Repeat until every bit of compressed data has been consumed.
 
+   Compressed file structure:
 
+   ------------------------------------------------------------------------------------------
+   |              |                |                   |                  |                    |
+   |  "HUF" + 2   |  Code Lengths  |  Compressed Data  |  Trailing Zeros  |  # Trailing Zeros  |
+   |     (4B)     |    (<=258B)    |    (Any Size)     |      (<1B)       |        (1B)        |
+   ------------------------------------------------------------------------------------------
 
-/* Decompression Methods */
+*/
 
-/* DecompressFile
-   --------------
-   Decompresses the binary tree and uses it to step bit by bit through a file.
-   This process is rather slow for large files since we look at each bit
-   one at a time. The process is as follows:
+bool HuffmanCompressor::decompressCanonical(ifstream& infile, ofstream& outfile) const {
+    uint8_t lengths[Codebook::NUM_SYMBOLS];
+    if (!readCodeLengths(infile, lengths)) {
+        return false;
+    }
+
+    uint64_t bytesOfData;
+    uint64_t bitsOfData;
+    if (!findDataBits(infile, bytesOfData, bitsOfData)) {
+        return false;
+    }
+
+    Codebook codebook(lengths);
+    DecodeTable table(codebook);
+    decodeData(infile, outfile, table, bytesOfData, bitsOfData);
+    return (bool)outfile;
+}
 
-   1. Read a bit from the current byte being looked at
-   2. Step through the binary tree (1 means right, 0 means left)
-   3. If necessary, gather a new byte of data.
-   4. If we find a leaf, then output the character on that leaf to the outfile, then reset tree.
-   5. If we reach the second to last byte, compare the bit index to the number of trailing zeros,
-        which was stored in the last byte.
+
+/* decompressLegacy
+   ----------------
+   Decompresses a file from before the format was versioned, by
+   reconstructing the binary tree that was stored in it and turning
+   its codes into a DecodeTable.
 
    Compressed file structure:
 
@@ -134,88 +1307,310 @@ void HuffmanCompressor::compressFile(string infileName, string outfileName) {
 
 */
 
-void HuffmanCompressor::decompressFile(string compressedFile, string outputFile) {
-    ifstream infile;
-    ofstream outfile;
-
-    infile.open(compressedFile, ios::binary);
-    outfile.open(outputFile, ios::binary);
-
+bool HuffmanCompressor::decompressLegacy(ifstream& infile, ofstream& outfile) const {
     Tree freqTree;
     freqTree.decompressTree(infile);
+    if (freqTree.root == nullptr) {
+        return false;
+    }
 
-    /* Gather footer data (last 1 byte), then reset back to where we were */
-
-    const uint32_t fileLength = getFileLength(infile);
-    const uint8_t nTrailingZeros = getTrailingZeros(infile);
+    uint64_t bytesOfData;
+    uint64_t bitsOfData;
+    if (!findDataBits(infile, bytesOfData, bitsOfData)) {
+        return false;
+    }
 
     /* Special case if the file input was only one character repeated and thus our tree is only one node */
 
     if (freqTree.root->isLeaf) {
-        uint8_t byte = freqTree.root->byte;
-        uint32_t bytesOfData = fileLength - (uint32_t)infile.tellg();
-        uint32_t numRepeatedChars = bytesOfData * 8 - nTrailingZeros;
-        for (uint32_t i = 0; i < numRepeatedChars; i++) {
-            outfile << byte;
+        vector<uint8_t> buffer(IO_BUFFER_SIZE, freqTree.root->byte);
+        uint64_t numRepeatedChars = bitsOfData; //one bit for each, so never more than the file holds
+        while (numRepeatedChars > 0) {
+            size_t n = (size_t)min<uint64_t>(numRepeatedChars, buffer.size());
+            outfile.write((const char*)buffer.data(), n);
+            numRepeatedChars -= n;
         }
     }
     else {
+        Codebook codebook(freqTree);
+        DecodeTable table(codebook);
+        decodeData(infile, outfile, table, bytesOfData, bitsOfData);
+    }
+    return (bool)outfile;
+}
 
-        /* Decompression Variables */
 
-        char ch;
-        uint8_t byte;
-        uint8_t index = 8; //index of the bit we are looking at in the current byte
+/* decodeData
+   ----------
+   Reads the compressed data in large chunks and decodes each one with
+   the DecodeTable. A code can straddle two chunks, so whatever the
+   table could not finish is moved to the front of the buffer, and the
+   next chunk is read in behind it. Since that leftover may start part
+   way through a byte, the number of bits of it that were already used
+   is carried over as well.
+*/
 
-        /* Outer Loop that searches each compressed bit representation in the file */
+void HuffmanCompressor::decodeData(ifstream& infile, ofstream& outfile, const DecodeTable& table,
+                                   uint64_t bytesOfData, uint64_t bitsOfData) const {
+    vector<uint8_t> input(IO_BUFFER_SIZE);
+    vector<uint8_t> output(IO_BUFFER_SIZE);
 
-        while (infile.tellg() <= fileLength) {
-            Node* currentNode = freqTree.root;
+    size_t carried = 0;
+    uint32_t usedBits = 0;
 
-            /* Inner loop that searches binary tree until hitting a leaf */
+    while (bitsOfData > 0) {
+        size_t toRead = (size_t)min<uint64_t>(input.size() - carried, bytesOfData);
+        infile.read((char*)input.data() + carried, toRead);
+        bytesOfData -= toRead;
 
-            while (!currentNode->isLeaf) {
-                if (index == 8) {
-                    //gather a new byte of data
-                    infile.get(ch);
-                    byte = (uint8_t)ch;
-                    index = 0;
-                }
+        size_t available = carried + toRead;
+        uint64_t chunkBits = min<uint64_t>((uint64_t)available * 8, usedBits + bitsOfData);
 
-                if (infile.tellg() == fileLength && (8 - index) == nTrailingZeros) {
-                    /* If we are at the last byte, then when (8 - index) = trailingZeros, 
-                       we have reached the end of the compressed data */
-                    infile.get(ch);
-                    break;
-                }
+        BitReader reader(input.data(), available, chunkBits);
+        reader.refill();
+        reader.consume(usedBits);
+
+        size_t n;
+        while ((n = table.decode(reader, output.data(), output.size())) > 0) {
+            outfile.write((const char*)output.data(), n);
+        }
+
+        uint64_t consumedBits = reader.bitsConsumed();
+        if (consumedBits == usedBits && toRead == 0) {
+            break; //no progress and no more data, so the rest cannot be decoded
+        }
+        bitsOfData -= consumedBits - usedBits;
 
-                /* Isolate the bit at index */
+        size_t consumedBytes = (size_t)(consumedBits / 8);
+        usedBits = (uint32_t)(consumedBits % 8);
+        carried = available - consumedBytes;
+        memmove(input.data(), input.data() + consumedBytes, carried);
+    }
+}
 
-                uint8_t currentBit = byte;
-                uint8_t indexBit = (1 << (8 - 1 - index));
-                currentBit &= indexBit;
 
-                /* Step further into the tree based on that bit */
+/* readCodeLengths
+   ---------------
+   Reads and unpacks the code lengths that start at the current
+   position, leaving the file just past them. Returns false if they
+   are not a valid set of code lengths.
+*/
 
-                if (currentBit >= 1) {
-                    currentNode = currentNode->right;
-                }
-                else if (currentBit == 0) {
-                    currentNode = currentNode->left;
-                }
-                index++;
-            }
+bool HuffmanCompressor::readCodeLengths(ifstream& infile, uint8_t lengths[Codebook::NUM_SYMBOLS]) const {
+    streampos lengthsStart = infile.tellg();
 
-            /* A leaf has been found */
+    uint8_t packedLengths[Codebook::MAX_LENGTHS_SIZE];
+    infile.read((char*)packedLengths, sizeof(packedLengths));
+    size_t nRead = (size_t)infile.gcount();
+    infile.clear();
 
-            if (infile.tellg() <= fileLength) {
-                uint8_t correctChar = currentNode->byte;
-                outfile << correctChar;
-            }
+    size_t lengthsSize = Codebook::readLengths(packedLengths, nRead, lengths);
+    infile.seekg(lengthsStart + (streamoff)lengthsSize);
+    return lengthsSize > 0;
+}
+
+
+/* readBlockFile
+   -------------
+   Reads the rest of the header of a block file, just after its version,
+   and the block index from the end of it, along with a codec for its
+   blocks. Returns false if any of them are missing.
+*/
+
+bool HuffmanCompressor::readBlockFile(ifstream& infile, unique_ptr<Codebook>& sharedCodebook,
+                                      unique_ptr<BlockCodec>& codec, vector<BlockEntry>& index) const {
+    uint8_t header[MAX_HEADER_SIZE - 4];
+    infile.read((char*)header, sizeof(header));
+    size_t headerSize = (size_t)infile.gcount();
+    infile.clear();
+
+    return headerSize >= 4 && readSharedCodes(header + 4, headerSize - 4, sharedCodebook, codec)
+        && readBlockIndex(infile, BlockCodec::getUInt32(header), index);
+}
+
+
+/* readBlockIndex
+   --------------
+   Reads the trailer at the very end of the file to find the block
+   index, then reads every entry of it. Returns false unless the index
+   sits exactly between the end marker and the trailer, and every entry
+   in it is one the file could really hold.
+*/
+
+bool HuffmanCompressor::readBlockIndex(ifstream& infile, uint32_t blockSize, vector<BlockEntry>& index) const {
+    uint8_t trailer[TRAILER_SIZE];
+    infile.seekg(0, infile.end);
+    uint64_t fileLength = (uint64_t)infile.tellg();
+    infile.seekg(-(streamoff)TRAILER_SIZE, infile.end);
+    infile.read((char*)trailer, sizeof(trailer));
+
+    uint64_t indexOffset;
+    uint32_t blockCount;
+    if (infile.gcount() != TRAILER_SIZE || !readTrailer(trailer, indexOffset, blockCount)
+        || indexOffset > fileLength - TRAILER_SIZE
+        || (uint64_t)blockCount * BLOCK_ENTRY_SIZE != fileLength - TRAILER_SIZE - indexOffset) {
+        return false;
+    }
+
+    vector<uint8_t> entries((size_t)blockCount * BLOCK_ENTRY_SIZE);
+    infile.seekg((streamoff)indexOffset);
+    infile.read((char*)entries.data(), entries.size());
+    if ((size_t)infile.gcount() != entries.size()) {
+        return false;
+    }
+
+    readIndexEntries(entries.data(), blockCount, index);
+    return checkIndexEntries(index, indexOffset, blockSize);
+}
+
+
+/* The same, for a whole compressed buffer in memory, whose header
+   gives the block size */
+
+bool HuffmanCompressor::readBlockIndex(const uint8_t* in, size_t size, vector<BlockEntry>& index) const {
+    uint64_t indexOffset;
+    uint32_t blockCount;
+    if (size < 4 + 4 + TRAILER_SIZE || !readTrailer(in + size - TRAILER_SIZE, indexOffset, blockCount)) {
+        return false;
+    }
+
+    uint64_t indexSize = (uint64_t)blockCount * BLOCK_ENTRY_SIZE;
+    if (indexOffset > size - TRAILER_SIZE || indexSize != size - TRAILER_SIZE - indexOffset) {
+        return false;
+    }
+
+    readIndexEntries(in + indexOffset, blockCount, index);
+    return checkIndexEntries(index, indexOffset, BlockCodec::getUInt32(in + 4));
+}
+
+
+/* readTrailer
+   -----------
+   Checks the trailer ends with the magic bytes and the version, and
+   unpacks where the index starts and how many entries it has.
+*/
+
+bool HuffmanCompressor::readTrailer(const uint8_t trailer[TRAILER_SIZE], uint64_t& indexOffset, uint32_t& blockCount) const {
+    if (BlockCodec::getUInt32(trailer + 12) != (MAGIC | ((uint32_t)BLOCK_VERSION << 24))) {
+        return false;
+    }
+    indexOffset = BlockCodec::getUInt64(trailer);
+    blockCount = BlockCodec::getUInt32(trailer + 8);
+    return true;
+}
+
+
+/* readIndexEntries
+   ----------------
+   Unpacks blockCount entries of the block index.
+*/
+
+void HuffmanCompressor::readIndexEntries(const uint8_t* entries, uint32_t blockCount, vector<BlockEntry>& index) const {
+    index.resize(blockCount);
+    for (size_t i = 0; i < blockCount; i++) {
+        const uint8_t* entry = &entries[i * BLOCK_ENTRY_SIZE];
+        index[i].offset = BlockCodec::getUInt64(entry);
+        index[i].recordSize = BlockCodec::getUInt32(entry + 8);
+        index[i].uncompressedSize = BlockCodec::getUInt32(entry + 12);
+    }
+}
+
+
+/* checkIndexEntries
+   -----------------
+   Checks every entry of the block index against what readRecord would
+   accept: no block bigger than blockSize, no record too big for its
+   block, and every record inside the blocks that end at the end marker
+   just before indexOffset.
+*/
+
+bool HuffmanCompressor::checkIndexEntries(const vector<BlockEntry>& index, uint64_t indexOffset, uint32_t blockSize) const {
+    if (indexOffset < 4 + 4 + 1 + 1) {
+        return false; //no room for the header and the end marker
+    }
+    uint64_t blocksEnd = indexOffset - 1;
+
+    for (const BlockEntry& entry : index) {
+        if (entry.uncompressedSize > blockSize
+            || entry.recordSize < BlockCodec::HEADER_SIZE
+            || entry.recordSize > BlockCodec::HEADER_SIZE + BlockCodec::maxPayloadSize(entry.uncompressedSize)
+            || entry.offset < 4 + 4 + 1
+            || entry.offset > blocksEnd || entry.recordSize > blocksEnd - entry.offset) {
+            return false;
         }
     }
-    infile.close();
-    outfile.close();
+    return true;
+}
+
+
+/* readSharedCodes
+   ---------------
+   Reads what follows the block size in the header, which is either
+   NO_SHARED_CODES or the lengths of the codes every block shares, and
+   creates a codec to match. Returns false if neither is there.
+*/
+
+bool HuffmanCompressor::readSharedCodes(const uint8_t* in, size_t size, unique_ptr<Codebook>& sharedCodebook,
+                                        unique_ptr<BlockCodec>& codec) const {
+    if (size > 0 && in[0] == NO_SHARED_CODES) {
+        codec.reset(new BlockCodec());
+        return true;
+    }
+
+    uint8_t lengths[Codebook::NUM_SYMBOLS];
+    if (Codebook::readLengths(in, size, lengths) == 0) {
+        return false;
+    }
+    sharedCodebook.reset(new Codebook(lengths));
+    codec.reset(new BlockCodec(*sharedCodebook));
+    return true;
+}
+
+
+/* findOutputOffsets
+   -----------------
+   Adds up the uncompressed sizes in the index to find where every
+   block starts in the output. Returns the size of the whole output.
+*/
+
+uint64_t HuffmanCompressor::findOutputOffsets(const vector<BlockEntry>& index, vector<uint64_t>& outputOffsets) const {
+    outputOffsets.resize(index.size());
+    uint64_t outputSize = 0;
+    for (size_t i = 0; i < index.size(); i++) {
+        outputOffsets[i] = outputSize;
+        outputSize += index[i].uncompressedSize;
+    }
+    return outputSize;
+}
+
+
+/* findDataBits
+   ------------
+   Works out how many bytes of compressed data there are, from the
+   current position up to the footer, and how many bits of them are
+   used, from the number of trailing zeros stored in the last byte.
+   The file is left where it was. Returns false if the footer does not
+   fit the data, which can only be 0 to 7 bits short of a whole byte.
+*/
+
+bool HuffmanCompressor::findDataBits(ifstream& infile, uint64_t& bytesOfData, uint64_t& bitsOfData) const {
+    streamoff dataStart = infile.tellg();
+    if (!infile || dataStart < 0) {
+        return false;
+    }
+
+    const uint64_t fileLength = getFileLength(infile);
+    const uint32_t nTrailingZeros = getTrailingZeros(infile);
+    if (!infile || (uint64_t)dataStart > fileLength) {
+        return false;
+    }
+
+    bytesOfData = fileLength - (uint64_t)dataStart;
+    if (nTrailingZeros > 7 || nTrailingZeros > bytesOfData * 8) {
+        return false;
+    }
+    bitsOfData = bytesOfData * 8 - nTrailingZeros;
+    return true;
 }
 
 
@@ -225,10 +1620,10 @@ void HuffmanCompressor::decompressFile(string compressedFile, string outputFile)
    and retrieve the length.
 */
 
-const uint32_t HuffmanCompressor::getFileLength(ifstream& infile) const {
+const uint64_t HuffmanCompressor::getFileLength(ifstream& infile) const {
     streampos currentPos = infile.tellg();
     infile.seekg(-1, infile.end);
-    uint32_t length = (uint32_t)infile.tellg();
+    uint64_t length = (uint64_t)infile.tellg();
     infile.seekg(currentPos);
     return length;
 }
@@ -247,5 +1642,299 @@ const uint32_t HuffmanCompressor::getTrailingZeros(ifstream& infile) const {
     char trailingZeros;
     infile.get(trailingZeros);
     infile.seekg(currentPos);
-    return (uint32_t)trailingZeros;
+    return (uint8_t)trailingZeros;
+}
+
+
+
+/* Archive Methods */
+
+/* writeArchive
+   ------------
+   Writes each member as a complete compressed stream, exactly as
+   compressStream would, one after another. Every member's place, sizes
+   and checksum are tallied up as it goes by, and only written out at
+   the end, in the central directory, which is found from the trailer.
+   So the archive is written in a single pass, and any member can be
+   found later without reading the ones before it.
+
+   Archive structure:
+
+   ----------------------------------------------------------------
+   |             |                     |             |            |
+   |  "HUF" + A  |  Members            |  Central    |  Trailer   |
+   |    (4B)     |  (Any)              |  Directory  |   (16B)    |
+   ----------------------------------------------------------------
+
+   Member:              A compressed stream, in the same format as compressFile
+   Directory entry:     | Name Length (2B) | Name | Offset (8B) | Compressed Size (8B) |
+                        | Uncompressed Size (8B) | CRC-32 (4B) |
+   Trailer:             | Directory Offset (8B) | Member Count (4B) | "HUF" + A (4B) |
+*/
+
+bool HuffmanCompressor::writeArchive(const vector<ArchiveMember>& members, ostream& out) {
+    uint64_t offset = 0;
+    function<bool(const uint8_t*, size_t)> write = [&](const uint8_t* data, size_t size) {
+        out.write((const char*)data, size);
+        offset += size;
+        return (bool)out;
+    };
+
+    uint8_t magic[4];
+    BlockCodec::putUInt32(magic, MAGIC | ((uint32_t)ARCHIVE_TAG << 24));
+    if (members.size() > MAX_MEMBER_COUNT || !write(magic, sizeof(magic))) {
+        return false;
+    }
+
+    /* Members */
+
+    vector<ArchiveEntry> directory;
+    for (const ArchiveMember& member : members) {
+        ifstream infile(member.input, ios::binary);
+        if (!infile || member.name.size() > MAX_NAME_LENGTH) {
+            return false;
+        }
+
+        unique_ptr<Codebook> sharedCodebook;
+        if (options.sharedCodes) {
+            sharedCodebook = buildSharedCodebook(countSharedCodes(member.input, threadCount()));
+        }
+
+        ArchiveEntry entry;
+        entry.name = member.name;
+        entry.offset = offset;
+        bool written = compressStream(infile, sharedCodebook.get(),
+            [&](const uint8_t* data, size_t size) {
+                entry.uncompressedSize += size;
+                entry.checksum = Crc32::update(entry.checksum, data, size);
+            },
+            write);
+        if (!written) {
+            return false;
+        }
+        entry.compressedSize = offset - entry.offset;
+        directory.push_back(entry);
+    }
+
+    /* Central directory and trailer */
+
+    uint64_t directoryOffset = offset;
+    vector<uint8_t> buffer;
+    for (const ArchiveEntry& entry : directory) {
+        buffer.resize(ARCHIVE_ENTRY_SIZE + entry.name.size());
+        uint8_t* field = buffer.data();
+        field[0] = (uint8_t)entry.name.size();
+        field[1] = (uint8_t)(entry.name.size() >> 8);
+        memcpy(field + 2, entry.name.data(), entry.name.size());
+        field += 2 + entry.name.size();
+        BlockCodec::putUInt64(field, entry.offset);
+        BlockCodec::putUInt64(field + 8, entry.compressedSize);
+        BlockCodec::putUInt64(field + 16, entry.uncompressedSize);
+        BlockCodec::putUInt32(field + 24, entry.checksum);
+        if (!write(buffer.data(), buffer.size())) {
+            return false;
+        }
+    }
+
+    uint8_t trailer[TRAILER_SIZE];
+    BlockCodec::putUInt64(trailer, directoryOffset);
+    BlockCodec::putUInt32(trailer + 8, (uint32_t)directory.size());
+    BlockCodec::putUInt32(trailer + 12, MAGIC | ((uint32_t)ARCHIVE_TAG << 24));
+    return write(trailer, sizeof(trailer)) && (bool)out.flush();
+}
+
+
+/* readArchiveDirectory
+   --------------------
+   Reads the trailer at the end of the archive, then the directory it
+   points to, checking that every entry fits within the archive.
+*/
+
+bool HuffmanCompressor::readArchiveDirectory(string archiveFile, vector<ArchiveEntry>& directory) const {
+    ifstream infile(archiveFile, ios::binary);
+    return readArchiveDirectory(infile, directory);
+}
+
+bool HuffmanCompressor::readArchiveDirectory(ifstream& infile, vector<ArchiveEntry>& directory) const {
+    directory.clear();
+
+    uint8_t magic[4];
+    infile.read((char*)magic, sizeof(magic));
+    infile.seekg(0, infile.end);
+    uint64_t fileSize = (uint64_t)infile.tellg();
+    const uint32_t archiveMagic = MAGIC | ((uint32_t)ARCHIVE_TAG << 24);
+    if (!infile || fileSize < sizeof(magic) + TRAILER_SIZE || BlockCodec::getUInt32(magic) != archiveMagic) {
+        return false;
+    }
+
+    uint8_t trailer[TRAILER_SIZE];
+    infile.seekg((streamoff)(fileSize - TRAILER_SIZE));
+    infile.read((char*)trailer, sizeof(trailer));
+    uint64_t directoryOffset = BlockCodec::getUInt64(trailer);
+    uint32_t memberCount = BlockCodec::getUInt32(trailer + 8);
+    uint64_t directoryEnd = fileSize - TRAILER_SIZE;
+    if (!infile || BlockCodec::getUInt32(trailer + 12) != archiveMagic
+        || directoryOffset < sizeof(magic) || directoryOffset > directoryEnd
+        || memberCount > (directoryEnd - directoryOffset) / ARCHIVE_ENTRY_SIZE) {
+        return false;
+    }
+
+    vector<uint8_t> buffer((size_t)(directoryEnd - directoryOffset));
+    infile.seekg((streamoff)directoryOffset);
+    infile.read((char*)buffer.data(), buffer.size());
+    if (!infile) {
+        return false;
+    }
+
+    size_t position = 0;
+    for (uint32_t i = 0; i < memberCount; i++) {
+        if (buffer.size() - position < ARCHIVE_ENTRY_SIZE) {
+            return false;
+        }
+        size_t nameLength = buffer[position] | ((size_t)buffer[position + 1] << 8);
+        if (buffer.size() - position - ARCHIVE_ENTRY_SIZE < nameLength) {
+            return false;
+        }
+
+        ArchiveEntry entry;
+        entry.name.assign((const char*)&buffer[position + 2], nameLength);
+        const uint8_t* field = &buffer[position + 2 + nameLength];
+        entry.offset = BlockCodec::getUInt64(field);
+        entry.compressedSize = BlockCodec::getUInt64(field + 8);
+        entry.uncompressedSize = BlockCodec::getUInt64(field + 16);
+        entry.checksum = BlockCodec::getUInt32(field + 24);
+        if (entry.offset < sizeof(magic) || entry.offset > directoryOffset
+            || entry.compressedSize > directoryOffset - entry.offset) {
+            return false;
+        }
+
+        directory.push_back(entry);
+        position += ARCHIVE_ENTRY_SIZE + nameLength;
+    }
+    return position == buffer.size();
+}
+
+
+/* extractMember
+   -------------
+   Finds the member in the directory, seeks to it and decompresses it
+   like any other compressed stream. The decompressed bytes are checked
+   against the directory's size and checksum on their way out, and the
+   stream has to end exactly where the directory says the member does.
+*/
+
+bool HuffmanCompressor::extractMember(string archiveFile, string name, ostream& out) {
+    ifstream infile(archiveFile, ios::binary);
+    vector<ArchiveEntry> directory;
+    if (!readArchiveDirectory(infile, directory)) {
+        return false;
+    }
+
+    vector<ArchiveEntry>::const_iterator entry = find_if(directory.begin(), directory.end(),
+        [&](const ArchiveEntry& candidate) { return candidate.name == name; });
+    if (entry == directory.end()) {
+        return false;
+    }
+
+    uint64_t size = 0;
+    uint32_t checksum = 0;
+    infile.seekg((streamoff)entry->offset);
+    bool decompressed = decompressStream(infile,
+        [&](const uint8_t* data, size_t dataSize) {
+            size += dataSize;
+            checksum = Crc32::update(checksum, data, dataSize);
+            out.write((const char*)data, dataSize);
+            return size <= entry->uncompressedSize && (bool)out;
+        });
+
+    return decompressed && (uint64_t)infile.tellg() == entry->offset + entry->compressedSize
+        && size == entry->uncompressedSize && checksum == entry->checksum && (bool)out.flush();
+}
+
+
+
+/* Format Methods */
+
+/* threadCount
+   -----------
+   Returns how many threads to compress or decompress with.
+*/
+
+size_t HuffmanCompressor::threadCount() const {
+    return (options.nThreads > 0) ? options.nThreads : ThreadPool::defaultThreadCount();
+}
+
+
+/* secondsSince
+   ------------
+   Returns how many seconds have gone by since start.
+*/
+
+double HuffmanCompressor::secondsSince(const chrono::steady_clock::time_point& start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+
+/* fileSize
+   --------
+   Returns the size of a file, or 0 if it cannot be opened.
+*/
+
+uint64_t HuffmanCompressor::fileSize(const string& filename) {
+    ifstream infile(filename, ios::binary | ios::ate);
+    return infile ? (uint64_t)infile.tellg() : 0;
+}
+
+
+
+/* writeHeader
+   -----------
+   Writes the magic bytes "HUF" followed by the format version, the block
+   size and the shared code lengths (or NO_SHARED_CODES if there are none).
+   Returns the size of the header, which is at most MAX_HEADER_SIZE.
+*/
+
+size_t HuffmanCompressor::writeHeader(uint8_t* out, const Codebook* sharedCodebook) const {
+    out[0] = (uint8_t)(MAGIC & 0xFF);
+    out[1] = (uint8_t)((MAGIC >> 8) & 0xFF);
+    out[2] = (uint8_t)((MAGIC >> 16) & 0xFF);
+    out[3] = BLOCK_VERSION;
+    BlockCodec::putUInt32(out + 4, options.blockSize);
+
+    if (sharedCodebook != nullptr) {
+        return 8 + sharedCodebook->writeLengths(out + 8);
+    }
+    out[8] = NO_SHARED_CODES;
+    return 9;
+}
+
+
+/* readVersion
+   -----------
+   Reads the header and returns the format version. A legacy file
+   starts with its tree (whose first sentinel is always a LEAF), so
+   if the magic bytes are not there we rewind and treat it as one.
+*/
+
+uint8_t HuffmanCompressor::readVersion(ifstream& infile) const {
+    uint8_t header[4];
+    infile.read((char*)header, sizeof(header));
+
+    if (infile.gcount() == sizeof(header) && readVersion(header, sizeof(header)) != LEGACY_VERSION) {
+        return header[3];
+    }
+
+    infile.clear();
+    infile.seekg(0);
+    return LEGACY_VERSION;
+}
+
+
+/* The same, for a compressed buffer in memory */
+
+uint8_t HuffmanCompressor::readVersion(const uint8_t* in, size_t size) const {
+    if (size >= 4 && (uint32_t)(in[0] | (in[1] << 8) | (in[2] << 16)) == MAGIC) {
+        return in[3];
+    }
+    return LEGACY_VERSION;
 }
\ No newline at end of file
@@ -1,6 +1,17 @@
 #pragma once
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <ostream>
 #include <string>
+#include <vector>
 
+#include "BlockCodec.h"
+#include "Codebook.h"
+#include "DecodeTable.h"
+#include "Dictionary.h"
 #include "Tree.h"
 
 using namespace std;
@@ -12,6 +23,11 @@ using namespace std;
    Compresses and decompresses a file byte by byte. The
    compression ratio can be anywhere around 50% to 70%
    based on the amount of repetition or diversity in the file.
+
+   Files are split into blocks that are compressed independently,
+   so several threads can work on one file at the same time. Buffers
+   in memory can be compressed into the same format without going
+   through a file at all.
 */
 
 
@@ -20,30 +36,495 @@ class HuffmanCompressor
 {
 public:
 
+    /* Options
+       -------
+       Settings for how files are compressed. A thread count of 0
+       means one thread per hardware thread. A blockSize below
+       4KB or above 1GB is moved to the nearer of the two.
+
+       By default every block gets its own codes, so the input is read
+       only once. With sharedCodes the whole file is counted first and
+       every block uses the same codes, which reads the input twice.
+
+       No code is longer than maxCodeLength bits, which can be anywhere
+       from 8 to 32. Shorter limits cost a little compression on skewed
+       files, but keep more codes within a single table lookup.
+
+       With splitStreams each block is coded as four streams that one
+       thread decodes side by side, which is much faster to decompress
+       for a few extra bytes per block.
+
+       With contextCodes a block may instead get order-1 codes, where
+       each byte is coded with a table picked by the byte before it.
+       This makes text and logs noticeably smaller, but compresses and
+       decompresses those blocks more slowly.
+
+       An lzLevel from 1 to 9 finds repeated strings within each block
+       first (LZ77), which shrinks repetitive data such as logs many
+       times over. Higher levels search harder for longer matches and
+       compress more slowly. 0 leaves it out.
+
+       With sharedCodes, a sampleChunks above 0 builds the shared codes
+       from only that many 64KB chunks, spread evenly through the input,
+       so a huge file is read little more than once. Every byte still
+       gets a code, even ones the sample missed. 0 counts everything.
+    */
+
+    struct Options {
+        uint32_t blockSize = 1 << 20;
+        uint32_t nThreads = 0;
+        bool sharedCodes = false;
+        uint32_t maxCodeLength = 15;
+        bool splitStreams = true;
+        bool contextCodes = false;
+        uint32_t lzLevel = 0;
+        uint32_t sampleChunks = 0;
+    };
+
+
+    /* Stats
+       -----
+       What compressFile or decompressFile did and where the time went,
+       filled in when one is passed to them. Phases that run on several
+       threads at once add up the time of every thread, so together they
+       can come to more than totalSeconds.
+
+       histogram:  counting bytes, of the whole file with sharedCodes and
+                   of every block either way
+       tree:       building codes, or when decompressing, reading the
+                   header and index and rebuilding the shared codes
+       coding:     picking a mode and coding every block, or decoding them
+       read/write: waiting on the input and output files, with the number
+                   of calls made to read and write them
+
+       Symbol and code length stats come from compression only. The
+       average code length is over every byte, from the Huffman codes
+       each block built, whichever mode it was stored in.
+    */
+
+    struct Stats {
+        uint64_t bytesIn = 0;
+        uint64_t bytesOut = 0;
+        uint64_t nBlocks = 0;
+
+        double totalSeconds = 0;
+        double histogramSeconds = 0;
+        double treeSeconds = 0;
+        double codingSeconds = 0;
+        double readSeconds = 0;
+        double writeSeconds = 0;
+
+        uint32_t distinctSymbols = 0;
+        uint32_t maxCodeLength = 0;
+        double averageCodeLength = 0;
+
+        uint64_t readCalls = 0;
+        uint64_t writeCalls = 0;
+
+        void write(ostream& out) const;
+    };
+
+
+    /* BatchFile
+       ---------
+       One file of a batch, and where its compressed copy goes.
+    */
+
+    struct BatchFile {
+        string input;
+        string output;
+    };
+
+
+    /* BatchResult
+       -----------
+       What a batch did, as a whole: how many bytes went in and came
+       out, how long it took, and which files could not be compressed,
+       by their place in the batch.
+    */
+
+    struct BatchResult {
+        size_t nFiles = 0;
+        uint64_t bytesIn = 0;
+        uint64_t bytesOut = 0;
+        double seconds = 0;
+        vector<size_t> failed;
+
+        double megabytesPerSecond() const;
+    };
+
+
+    /* ArchiveMember
+       -------------
+       A file to put into an archive, and the name to store it under.
+    */
+
+    struct ArchiveMember {
+        string name;
+        string input;
+    };
+
+
+    /* ArchiveEntry
+       ------------
+       A member's entry in the central directory of an archive: where its
+       compressed data starts in the archive, how big it is before and
+       after compression, and the CRC-32 of its uncompressed bytes.
+    */
+
+    struct ArchiveEntry {
+        string name;
+        uint64_t offset = 0;
+        uint64_t compressedSize = 0;
+        uint64_t uncompressedSize = 0;
+        uint32_t checksum = 0;
+    };
+
+
+    /* Constructors */
+
+    HuffmanCompressor();
+
+    HuffmanCompressor(const Options& options);
+
+
     /* compressFile
        ------------
        Compresses a file by finding repetitive bytes and representing
-       them with smaller bit values. It must store the key along with the
-       file in order to decompress it.
+       them with smaller bit values. It must store the key (the length
+       of each byte's bit value) along with the file in order to
+       decompress it. Fills in stats if given. Returns false if the
+       input could not be read or the output could not be written.
        */
 
-    void compressFile(string infileName, string outfileName);
+    bool compressFile(string infileName, string outfileName, Stats* stats = nullptr);
+
+
+    /* compressBatch
+       -------------
+       Compresses every file of a batch, in the same format as
+       compressFile, with options.nThreads threads. Each file is
+       compressed start to finish by a single thread, so many files are
+       worked on at once, rather than many blocks of one file.
+    */
+
+    BatchResult compressBatch(const vector<BatchFile>& files);
+
+
+    /* compressBound
+       -------------
+       Returns the most that size bytes can compress to, for sizing
+       the output of compressBuffer.
+    */
+
+    size_t compressBound(size_t size) const;
+
+
+    /* compressBuffer
+       --------------
+       Compresses size bytes from in into out, in the same format as
+       compressFile. Returns the compressed size, or 0 if it would not
+       fit in capacity bytes. The second version sizes out itself.
+    */
+
+    size_t compressBuffer(const uint8_t* in, size_t size, uint8_t* out, size_t capacity);
+
+    size_t compressBuffer(const uint8_t* in, size_t size, vector<uint8_t>& out);
+
+
+    /* compressStream
+       --------------
+       Compresses everything that can be read from in into out, in the
+       same format as compressFile, without ever seeking. Works on pipes,
+       so blocks always get their own codes. Returns false if out failed.
+    */
+
+    bool compressStream(istream& in, ostream& out);
 
 
     /* decompressFile
        --------------
-       Decompresses a file by reconstructing the binary tree contained within
-       the compressed file, and then the file itself.
+       Decompresses a file by rebuilding the codes stored within the
+       compressed file, and then the file itself. Files written by
+       older versions of the compressor can still be decompressed.
+       Fills in stats if given. Returns false if the file is corrupt or
+       the output could not be written.
     */
 
-    void decompressFile(string cmpFilename, string decompressedFilename);
+    bool decompressFile(string cmpFilename, string decompressedFilename, Stats* stats = nullptr);
+
+
+    /* decompressedSize
+       ----------------
+       Finds how big a compressed buffer is once decompressed. Returns
+       false if it is not a valid compressed buffer.
+    */
+
+    bool decompressedSize(const uint8_t* in, size_t size, uint64_t& outSize) const;
+
+
+    /* decompressBuffer
+       ----------------
+       Decompresses a buffer written by compressBuffer (or the contents of
+       a file written by compressFile) into out, and sets outSize to the
+       number of bytes written. Returns false if the buffer is corrupt or
+       does not fit in capacity bytes. The second version sizes out itself.
+    */
+
+    bool decompressBuffer(const uint8_t* in, size_t size, uint8_t* out, size_t capacity, size_t& outSize);
+
+    bool decompressBuffer(const uint8_t* in, size_t size, vector<uint8_t>& out);
+
+
+    /* decompressStream
+       ----------------
+       Decompresses the compressed data read from in into out, reading
+       the blocks one after another without seeking and holding only a
+       few blocks in memory at a time. Returns false if the data is
+       corrupt or not in the block format.
+    */
+
+    bool decompressStream(istream& in, ostream& out);
+
+
+    /* decompressRange
+       ---------------
+       Decompresses only the length bytes starting at offset in the
+       original data into out, decoding just the blocks that hold them
+       rather than the whole file. A range that runs past the end of the
+       data is cut short. Returns false if the file is corrupt, is not in
+       the block format or offset is past the end of the data.
+    */
+
+    bool decompressRange(string compressedFile, uint64_t offset, uint64_t length, vector<uint8_t>& out);
+
+
+    /* compressMessage
+       ---------------
+       Compresses a small message with a trained dictionary's codes. The
+       message is not counted and no codes are stored with it, only the
+       dictionary's ID, its size and the coded bits, so it must be
+       decompressed with the same dictionary. Returns the compressed size, or 0 if it would not fit
+       in capacity bytes. The second version sizes out itself.
+    */
+
+    size_t compressMessage(const Dictionary& dictionary, const uint8_t* in, size_t size,
+                           uint8_t* out, size_t capacity) const;
+
+    size_t compressMessage(const Dictionary& dictionary, const uint8_t* in, size_t size, vector<uint8_t>& out) const;
+
+
+    /* decompressMessage
+       -----------------
+       Decompresses a message written by compressMessage with the same
+       dictionary. Returns false if the message is corrupt or was coded
+       with a dictionary of another ID.
+    */
+
+    bool decompressMessage(const Dictionary& dictionary, const uint8_t* in, size_t size, vector<uint8_t>& out) const;
+
+
+    /* writeArchive
+       ------------
+       Compresses every member into one archive, written to out from
+       start to finish without ever seeking, so out can be a pipe.
+       Returns false if a member could not be read or out failed.
+    */
+
+    bool writeArchive(const vector<ArchiveMember>& members, ostream& out);
+
+
+    /* readArchiveDirectory
+       --------------------
+       Reads the central directory of an archive, which lists every
+       member in the order they were written. Returns false if the file
+       is not a valid archive.
+    */
+
+    bool readArchiveDirectory(string archiveFile, vector<ArchiveEntry>& directory) const;
+
+
+    /* extractMember
+       -------------
+       Decompresses the member with the given name into out, seeking
+       straight to it with the central directory. If several members
+       have that name, the first is used. Returns false if there is no
+       such member, or it is corrupt or fails its checksum.
+    */
+
+    bool extractMember(string archiveFile, string name, ostream& out);
 
 
 private:
 
-    const uint32_t getFileLength(ifstream& infile) const;
+    /* Constants */
+
+    static const size_t IO_BUFFER_SIZE = 1 << 20;
+
+
+    /* Format Versions */
+
+    static const uint32_t MAGIC = 0x465548; //"HUF", least significant byte first
+    static const uint8_t LEGACY_VERSION = 1;
+    static const uint8_t CANONICAL_VERSION = 2;
+    static const uint8_t BLOCK_VERSION = 3;
+    static const uint8_t NO_SHARED_CODES = 0xFF; //in place of the code lengths when blocks have their own
+    static const size_t MAX_HEADER_SIZE = 4 + 4 + Codebook::MAX_LENGTHS_SIZE;
+    static const uint8_t ARCHIVE_TAG = 'A'; //in place of the version in an archive's header and trailer
+
+
+    /* Archive Directory */
+
+    static const size_t ARCHIVE_ENTRY_SIZE = 2 + 8 + 8 + 8 + 4; //not counting the name
+    static const size_t MAX_NAME_LENGTH = 0xFFFF;
+    static const size_t MAX_MEMBER_COUNT = 0xFFFFFFFF;
+
+
+    /* Block Index */
+
+    static const size_t BLOCK_ENTRY_SIZE = 16;
+    static const uint32_t MIN_BLOCK_SIZE = 1 << 12;
+    static const uint32_t MAX_BLOCK_SIZE = 1 << 30;
+    static const size_t MAX_BLOCK_COUNT = 0xFFFFFFFF;
+    static const size_t TRAILER_SIZE = 16;
+
+    struct BlockEntry {
+        uint64_t offset;
+        uint32_t recordSize;
+        uint32_t uncompressedSize;
+    };
+
+
+    /* PipelineSlot
+       ------------
+       One block on its way through the compression pipeline. END marks
+       the slot after the last block.
+    */
+
+    struct PipelineSlot {
+        static const uint8_t FREE = 0;
+        static const uint8_t COMPRESSING = 1;
+        static const uint8_t COMPRESSED = 2;
+        static const uint8_t END = 3;
+
+        atomic<uint8_t> state{ FREE };
+        vector<uint8_t> buffer;
+        vector<uint8_t> record;
+        const uint8_t* block = nullptr;
+        size_t blockSize = 0;
+        BlockCodec::Stats stats;
+    };
+
+
+    /* BatchScratch
+       ------------
+       Everything one batch thread reuses from file to file, so that
+       only the first file it compresses pays for setting them up.
+    */
+
+    struct BatchScratch {
+        unique_ptr<BlockCodec> codec;
+        vector<uint8_t> block;
+        vector<uint8_t> record;
+        vector<BlockEntry> index;
+        uint64_t bytesIn = 0;
+        uint64_t bytesOut = 0;
+        vector<size_t> failed;
+    };
+
+
+    /* Private Variables */
+
+    Options options;
+
+
+    /* Private Methods */
+
+    size_t threadCount() const;
+
+    bool compressStream(istream& in, ostream& out, const Codebook* sharedCodebook, Stats* stats = nullptr);
+
+    bool compressStream(istream& in, const Codebook* sharedCodebook,
+                        const function<void(const uint8_t*, size_t)>& onRead,
+                        const function<bool(const uint8_t*, size_t)>& write, Stats* stats = nullptr);
+
+    bool compressBlocks(const BlockCodec& codec, uint64_t offset,
+                        const function<bool(vector<uint8_t>&, const uint8_t*&, size_t&)>& nextBlock,
+                        const function<bool(const uint8_t*, size_t)>& write, Stats* stats = nullptr) const;
+
+    bool compressBlocks(const BlockCodec& codec, uint64_t offset, const uint8_t* in, size_t size,
+                        const function<bool(const uint8_t*, size_t)>& write) const;
+
+    bool writeFooter(const vector<BlockEntry>& index, uint64_t offset,
+                     const function<bool(const uint8_t*, size_t)>& write) const;
+
+    static void backOff(size_t attempt);
+
+    bool compressBatchFile(const BatchFile& file, BatchScratch& scratch) const;
+
+    unique_ptr<Codebook> buildSharedCodebook(const FrequencyMap& freqMap) const;
+
+    FrequencyMap countSharedCodes(const string& filename, size_t nThreads) const;
+
+    FrequencyMap countSharedCodes(const uint8_t* data, size_t size) const;
+
+    unique_ptr<BlockCodec> createCodec(const Codebook* sharedCodebook) const;
+
+    bool decompressBlocks(ifstream& infile, ofstream& outfile,
+                          const string& compressedFile, const string& outputFile, Stats* stats) const;
+
+    bool decompressBlockRun(const string& compressedFile, const string& outputFile,
+                            const BlockCodec& codec, const vector<BlockEntry>& index,
+                            uint64_t outputOffset, size_t first, size_t last,
+                            const atomic<bool>& failed, Stats* stats) const;
+
+    static double secondsSince(const chrono::steady_clock::time_point& start);
+
+    static uint64_t fileSize(const string& filename);
+
+    bool decompressStream(istream& in, const function<bool(const uint8_t*, size_t)>& write);
+
+    bool readRecord(istream& in, uint32_t blockSize, vector<uint8_t>& record) const;
+
+    bool decompressCanonical(ifstream& infile, ofstream& outfile) const;
+
+    bool decompressLegacy(ifstream& infile, ofstream& outfile) const;
+
+    void decodeData(ifstream& infile, ofstream& outfile, const DecodeTable& table,
+                    uint64_t bytesOfData, uint64_t bitsOfData) const;
+
+    bool readCodeLengths(ifstream& infile, uint8_t lengths[Codebook::NUM_SYMBOLS]) const;
+
+    bool readBlockFile(ifstream& infile, unique_ptr<Codebook>& sharedCodebook,
+                       unique_ptr<BlockCodec>& codec, vector<BlockEntry>& index) const;
+
+    bool readBlockIndex(ifstream& infile, uint32_t blockSize, vector<BlockEntry>& index) const;
+
+    bool readBlockIndex(const uint8_t* in, size_t size, vector<BlockEntry>& index) const;
+
+    bool readTrailer(const uint8_t trailer[TRAILER_SIZE], uint64_t& indexOffset, uint32_t& blockCount) const;
+
+    void readIndexEntries(const uint8_t* entries, uint32_t blockCount, vector<BlockEntry>& index) const;
+
+    bool checkIndexEntries(const vector<BlockEntry>& index, uint64_t indexOffset, uint32_t blockSize) const;
+
+    bool readSharedCodes(const uint8_t* in, size_t size, unique_ptr<Codebook>& sharedCodebook,
+                         unique_ptr<BlockCodec>& codec) const;
+
+    bool readArchiveDirectory(ifstream& infile, vector<ArchiveEntry>& directory) const;
+
+    uint64_t findOutputOffsets(const vector<BlockEntry>& index, vector<uint64_t>& outputOffsets) const;
+
+    bool findDataBits(ifstream& infile, uint64_t& bytesOfData, uint64_t& bitsOfData) const;
+
+    const uint64_t getFileLength(ifstream& infile) const;
 
     const uint32_t getTrailingZeros(ifstream& infile) const;
 
-};
+    size_t writeHeader(uint8_t* out, const Codebook* sharedCodebook) const;
+
+    uint8_t readVersion(ifstream& infile) const;
+
+    uint8_t readVersion(const uint8_t* in, size_t size) const;
 
+};
\ No newline at end of file
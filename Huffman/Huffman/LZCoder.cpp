@@ -0,0 +1,314 @@
+#include <algorithm>
+
+#include "FrequencyMap.h"
+#include "LZCoder.h"
+
+
+
+/* LZCoder
+   -------
+   Finds matches with hash chains and codes the sequences they make
+   with four Huffman tables.
+*/
+
+
+
+/* Constants */
+
+constexpr uint32_t LZCoder::MIN_LEVEL;
+constexpr uint32_t LZCoder::MAX_LEVEL;
+constexpr size_t LZCoder::WINDOW_SIZE;
+constexpr uint32_t LZCoder::NO_POSITION;
+
+
+
+/* Levels */
+
+const LZCoder::LevelSettings LZCoder::LEVELS[MAX_LEVEL] = {
+    { 4, 16, false },
+    { 8, 32, false },
+    { 16, 64, false },
+    { 16, 32, true },
+    { 32, 64, true },
+    { 64, 128, true },
+    { 128, 258, true },
+    { 512, 258, true },
+    { 1024, 258, true },
+};
+
+
+
+/* Constructor */
+
+/* Finds the sequences, then counts the symbols of each table to build
+   its codes and to work out exactly how big the payload will be. A
+   table that nothing uses still needs one code to be valid. */
+
+LZCoder::LZCoder(const uint8_t* in, size_t size, uint32_t maxCodeLength, uint32_t level) {
+    findSequences(in, size, level);
+
+    uint64_t counts[NUM_TABLES][Codebook::NUM_SYMBOLS] = { { 0 } };
+    uint64_t extraBits = 0;
+    size_t position = 0;
+    uint32_t nExtraBits;
+
+    for (const Sequence& sequence : sequences) {
+        counts[LITERAL_COUNTS][bucketOf(sequence.nLiterals, nExtraBits)]++;
+        extraBits += nExtraBits;
+        for (size_t i = 0; i < sequence.nLiterals; i++) {
+            counts[LITERALS][in[position + i]]++;
+        }
+        position += sequence.nLiterals + sequence.matchLength;
+
+        if (sequence.matchLength > 0) {
+            counts[MATCH_LENGTHS][bucketOf(sequence.matchLength - MIN_MATCH, nExtraBits)]++;
+            extraBits += nExtraBits;
+            counts[DISTANCES][bucketOf(sequence.distance - 1, nExtraBits)]++;
+            extraBits += nExtraBits;
+        }
+    }
+
+    uint64_t totalBits = extraBits;
+    uint8_t lengths[Codebook::NUM_SYMBOLS];
+    uint8_t lengthsBuffer[Codebook::MAX_LENGTHS_SIZE];
+
+    for (size_t table = 0; table < NUM_TABLES; table++) {
+        if (*max_element(counts[table], counts[table] + Codebook::NUM_SYMBOLS) == 0) {
+            counts[table][0] = 1;
+        }
+        Codebook::buildLengths(FrequencyMap(counts[table]), maxCodeLength, lengths);
+        tables.push_back(Codebook(lengths));
+        payloadSize += tables[table].writeLengths(lengthsBuffer);
+
+        for (size_t symbol = 0; symbol < Codebook::NUM_SYMBOLS; symbol++) {
+            totalBits += counts[table][symbol] * tables[table].getCode((uint8_t)symbol).nBits;
+        }
+    }
+    payloadSize += (size_t)((totalBits + 7) / 8);
+}
+
+
+
+/* Public Interface */
+
+size_t LZCoder::encodedSize() const {
+    return payloadSize;
+}
+
+
+/* encode
+   ------
+   Writes the lengths of the four tables, then every sequence.
+*/
+
+size_t LZCoder::encode(const uint8_t* in, uint8_t* out) const {
+    size_t written = 0;
+    for (const Codebook& table : tables) {
+        written += table.writeLengths(out + written);
+    }
+
+    BitWriter writer(out + written);
+    size_t position = 0;
+
+    for (const Sequence& sequence : sequences) {
+        writeValue(writer, LITERAL_COUNTS, sequence.nLiterals);
+        for (size_t i = 0; i < sequence.nLiterals; i++) {
+            const Codebook::Code& code = tables[LITERALS].getCode(in[position + i]);
+            writer.write(code.bits, code.nBits);
+        }
+        position += sequence.nLiterals + sequence.matchLength;
+
+        if (sequence.matchLength > 0) {
+            writeValue(writer, MATCH_LENGTHS, sequence.matchLength - MIN_MATCH);
+            writeValue(writer, DISTANCES, sequence.distance - 1);
+        }
+    }
+
+    writer.finish();
+    return written + writer.bytesWritten();
+}
+
+
+/* decode
+   ------
+   Builds a DecodeTable for each of the four tables, then reads one
+   sequence at a time until the block is full. Runs of literals go
+   through the table's own decode, which takes whole runs at a time.
+   A match may overlap the bytes it is copying, so a match closer than
+   its length is copied one byte at a time.
+*/
+
+bool LZCoder::decode(const uint8_t* payload, size_t payloadSize, uint8_t* out, size_t outSize) {
+    vector<DecodeTable> decodeTables;
+    decodeTables.reserve(NUM_TABLES);
+    size_t read = 0;
+    uint8_t lengths[Codebook::NUM_SYMBOLS];
+
+    for (size_t table = 0; table < NUM_TABLES; table++) {
+        size_t lengthsSize = Codebook::readLengths(payload + read, payloadSize - read, lengths);
+        if (lengthsSize == 0) {
+            return false;
+        }
+        decodeTables.emplace_back(Codebook(lengths));
+        read += lengthsSize;
+    }
+
+    BitReader in(payload + read, payloadSize - read, (uint64_t)(payloadSize - read) * 8);
+    size_t written = 0;
+
+    while (written < outSize) {
+        uint32_t nLiterals;
+        if (!readValue(decodeTables[LITERAL_COUNTS], in, nLiterals) || nLiterals > outSize - written
+            || decodeTables[LITERALS].decode(in, out + written, nLiterals) != nLiterals) {
+            return false;
+        }
+        written += nLiterals;
+        if (written == outSize) {
+            break;
+        }
+
+        uint32_t length, distance;
+        if (!readValue(decodeTables[MATCH_LENGTHS], in, length) || !readValue(decodeTables[DISTANCES], in, distance)) {
+            return false;
+        }
+        length += MIN_MATCH;
+        distance += 1;
+        if (length < MIN_MATCH || length > outSize - written || distance == 0 || distance > written) {
+            return false;
+        }
+
+        uint8_t* target = out + written;
+        const uint8_t* source = target - distance;
+        if (distance >= length) {
+            memcpy(target, source, length);
+        }
+        else {
+            for (size_t i = 0; i < length; i++) {
+                target[i] = source[i];
+            }
+        }
+        written += length;
+    }
+    return true;
+}
+
+
+
+/* Private Methods */
+
+/* findSequences
+   -------------
+   Walks the block looking for a match at every position. With lazy
+   matching, a match is put off by a byte for as long as the next
+   position has a longer one. Every byte that is not covered by a match
+   becomes a literal of the sequence that ends with the next match.
+*/
+
+void LZCoder::findSequences(const uint8_t* in, size_t size, uint32_t level) {
+    MatchFinder finder;
+    finder.in = in;
+    finder.size = size;
+    finder.settings = LEVELS[min(max(level, MIN_LEVEL), MAX_LEVEL) - 1];
+    finder.head.assign((size_t)1 << HASH_BITS, NO_POSITION);
+    finder.chain.resize(min(size, WINDOW_SIZE));
+
+    size_t position = 0;
+    size_t literalStart = 0;
+
+    while (position + MIN_MATCH <= size) {
+        Match match = findMatch(finder, position);
+
+        while (finder.settings.lazy && match.length >= MIN_MATCH && match.length < finder.settings.niceLength
+               && position + 1 + MIN_MATCH <= size) {
+            Match next = findMatch(finder, position + 1);
+            if (next.length <= match.length) {
+                break;
+            }
+            match = next;
+            position++;
+        }
+
+        if (match.length < MIN_MATCH) {
+            position++;
+            continue;
+        }
+
+        sequences.push_back({ (uint32_t)(position - literalStart), match.length, match.distance });
+        position += match.length;
+        literalStart = position;
+    }
+
+    if (literalStart < size) {
+        sequences.push_back({ (uint32_t)(size - literalStart), 0, 0 });
+    }
+}
+
+
+/* findMatch
+   ---------
+   Links in every position up to this one, then walks its chain for the
+   longest match, newest first, giving up after maxChain links, past the
+   window, or once a match is niceLength long. A candidate can only be
+   longer than the best so far if it also matches the byte just past it,
+   which is checked before comparing the whole thing.
+*/
+
+LZCoder::Match LZCoder::findMatch(MatchFinder& finder, size_t position) {
+    insertUpTo(finder, position);
+
+    const uint8_t* in = finder.in;
+    uint32_t maxLength = (uint32_t)min<size_t>(finder.size - position, 0xFFFFFFFF);
+    Match best = { 0, 0 };
+
+    uint32_t candidate = finder.head[hashAt(in + position)];
+    for (uint32_t steps = 0; steps < finder.settings.maxChain && candidate != NO_POSITION; steps++) {
+        if (candidate >= position || position - candidate >= WINDOW_SIZE) {
+            break;
+        }
+        if (in[candidate + best.length] == in[position + best.length]) {
+            uint32_t length = matchLength(in + candidate, in + position, maxLength);
+            if (length > best.length) {
+                best.length = length;
+                best.distance = (uint32_t)(position - candidate);
+                if (length >= finder.settings.niceLength || length == maxLength) {
+                    break;
+                }
+            }
+        }
+        candidate = finder.chain[candidate & (WINDOW_SIZE - 1)];
+    }
+
+    insertUpTo(finder, position + 1);
+    return best;
+}
+
+
+/* insertUpTo
+   ----------
+   Links every position before position into the hash chains, as long
+   as it has MIN_MATCH bytes to hash.
+*/
+
+void LZCoder::insertUpTo(MatchFinder& finder, size_t position) {
+    size_t last = min(position, finder.size >= MIN_MATCH ? finder.size - MIN_MATCH + 1 : 0);
+    for (; finder.nextInsert < last; finder.nextInsert++) {
+        uint32_t hash = hashAt(finder.in + finder.nextInsert);
+        finder.chain[finder.nextInsert & (WINDOW_SIZE - 1)] = finder.head[hash];
+        finder.head[hash] = (uint32_t)finder.nextInsert;
+    }
+}
+
+
+/* writeValue
+   ----------
+   Writes a number as its bucket's code from table, then its extra bits.
+*/
+
+void LZCoder::writeValue(BitWriter& writer, size_t table, uint32_t value) const {
+    uint32_t nExtraBits;
+    const Codebook::Code& code = tables[table].getCode((uint8_t)bucketOf(value, nExtraBits));
+    writer.write(code.bits, code.nBits);
+    if (nExtraBits > 0) {
+        writer.write(value & ((1u << nExtraBits) - 1), nExtraBits);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,286 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "BitReader.h"
+#include "BitWriter.h"
+#include "Codebook.h"
+#include "DecodeTable.h"
+
+using namespace std;
+
+
+
+/* LZCoder
+   -------
+   LZ77 for one block, with Huffman codes for what it finds. Every
+   string that already appeared earlier in the block (within a window of
+   WINDOW_SIZE bytes) is replaced by how long it is and how far back it
+   was, so data that repeats itself shrinks by far more than coding
+   single bytes ever could.
+
+   The block becomes a list of sequences, each some literal bytes
+   followed by a match:
+
+       literal count, literal bytes, match length, match distance
+
+   The last sequence of a block may be just literals. Each number is
+   coded as a bucket symbol with its own Huffman table, followed by the
+   low bits of the number as they are, much like deflate. The literals
+   get a table of their own too, so the payload starts with four sets
+   of code lengths, then the coded sequences:
+
+   -----------------------------------------------------------------------
+   |            |                |               |            |          |
+   |  Literal   |  Literal Count |  Match Length |  Distance  |  Coded   |
+   |  Lengths   |  Lengths       |  Lengths      |  Lengths   |  Data    |
+   |  (<=258B)  |  (<=258B)      |  (<=258B)     |  (<=258B)  |  (Any)   |
+   -----------------------------------------------------------------------
+
+   Matches are found with hash chains, which link every position to the
+   last one whose next MIN_MATCH bytes hashed the same. The level trades
+   speed for smaller output, by how far down a chain to search and
+   whether to check if a match one byte later is longer (lazy matching).
+*/
+
+
+
+class LZCoder {
+public:
+
+    /* Constants */
+
+    static constexpr uint32_t MIN_LEVEL = 1;
+    static constexpr uint32_t MAX_LEVEL = 9;
+    static const uint32_t MIN_MATCH = 4;
+    static const uint32_t WINDOW_BITS = 16;
+    static constexpr size_t WINDOW_SIZE = (size_t)1 << WINDOW_BITS;
+
+
+    /* Constructor */
+
+    LZCoder(const uint8_t* in, size_t size, uint32_t maxCodeLength, uint32_t level);
+
+
+    /* Public Interface */
+
+
+    /* encodedSize
+       -----------
+       Returns exactly how many bytes encode will write for the block
+       the matches were found in.
+    */
+
+    size_t encodedSize() const;
+
+
+    /* encode
+       ------
+       Writes the whole payload for the block the matches were found in,
+       which in must point to. out needs room for encodedSize bytes plus
+       8 bytes of slack.
+       Returns the number of bytes written.
+    */
+
+    size_t encode(const uint8_t* in, uint8_t* out) const;
+
+
+    /* decode
+       ------
+       Decodes a payload written by encode into exactly outSize bytes.
+       Returns false if the payload is corrupt.
+    */
+
+    static bool decode(const uint8_t* payload, size_t payloadSize, uint8_t* out, size_t outSize);
+
+
+private:
+
+    /* Constants */
+
+    static const uint32_t HASH_BITS = 15;
+    static constexpr uint32_t NO_POSITION = 0xFFFFFFFF;
+    static const uint32_t DIRECT_BUCKETS = 16;  //numbers below this are their own bucket
+    static const uint32_t MAX_BUCKET = DIRECT_BUCKETS + 2 * (32 - 4) - 1;
+    static const size_t NUM_TABLES = 4;
+
+
+    /* Tables */
+
+    static const size_t LITERALS = 0;
+    static const size_t LITERAL_COUNTS = 1;
+    static const size_t MATCH_LENGTHS = 2;
+    static const size_t DISTANCES = 3;
+
+
+    /* Sequence
+       --------
+       Some literals and the match that follows them. A match length
+       of 0 means there is no match, at the very end of the block.
+    */
+
+    struct Sequence {
+        uint32_t nLiterals;
+        uint32_t matchLength;
+        uint32_t distance;
+    };
+
+
+    /* Match
+       -----
+       The longest match found at a position.
+    */
+
+    struct Match {
+        uint32_t length;
+        uint32_t distance;
+    };
+
+
+    /* LevelSettings
+       -------------
+       How hard each level looks for matches. The search of a chain
+       stops early once a match is niceLength long.
+    */
+
+    struct LevelSettings {
+        uint32_t maxChain;
+        uint32_t niceLength;
+        bool lazy;
+    };
+
+    static const LevelSettings LEVELS[MAX_LEVEL];
+
+
+    /* MatchFinder
+       -----------
+       The hash chains of the block being parsed, with every position
+       before nextInsert already linked in.
+    */
+
+    struct MatchFinder {
+        const uint8_t* in;
+        size_t size;
+        LevelSettings settings;
+        vector<uint32_t> head;
+        vector<uint32_t> chain;
+        size_t nextInsert = 0;
+    };
+
+
+    /* Private Variables */
+
+    vector<Sequence> sequences;
+    vector<Codebook> tables;
+    size_t payloadSize = 0;
+
+
+    /* Private Methods */
+
+    void findSequences(const uint8_t* in, size_t size, uint32_t level);
+
+    static Match findMatch(MatchFinder& finder, size_t position);
+
+    static void insertUpTo(MatchFinder& finder, size_t position);
+
+    static inline uint32_t hashAt(const uint8_t* in);
+
+    static inline uint32_t matchLength(const uint8_t* a, const uint8_t* b, uint32_t maxLength);
+
+    static inline uint32_t bucketOf(uint32_t value, uint32_t& nExtraBits);
+
+    static inline bool readValue(const DecodeTable& table, BitReader& in, uint32_t& value);
+
+    void writeValue(BitWriter& writer, size_t table, uint32_t value) const;
+
+};
+
+
+
+/* Inline Methods */
+
+/* hashAt
+   ------
+   Hashes the next MIN_MATCH bytes into HASH_BITS bits.
+*/
+
+inline uint32_t LZCoder::hashAt(const uint8_t* in) {
+    uint32_t word;
+    memcpy(&word, in, sizeof(word));
+    return (word * 2654435761u) >> (32 - HASH_BITS);
+}
+
+
+/* matchLength
+   -----------
+   Counts how many bytes a and b have in common from the start, up to
+   maxLength, comparing 8 bytes at a time while they are all the same.
+*/
+
+inline uint32_t LZCoder::matchLength(const uint8_t* a, const uint8_t* b, uint32_t maxLength) {
+    uint32_t length = 0;
+    while (length + 8 <= maxLength) {
+        uint64_t wordA, wordB;
+        memcpy(&wordA, a + length, sizeof(wordA));
+        memcpy(&wordB, b + length, sizeof(wordB));
+        if (wordA != wordB) {
+            break;
+        }
+        length += 8;
+    }
+    while (length < maxLength && a[length] == b[length]) {
+        length++;
+    }
+    return length;
+}
+
+
+/* bucketOf
+   --------
+   Numbers below DIRECT_BUCKETS are their own bucket. Every larger
+   number with its highest bit at n shares one of two buckets for n,
+   picked by the bit below the highest, and the n - 1 bits below that
+   are stored as they are.
+*/
+
+inline uint32_t LZCoder::bucketOf(uint32_t value, uint32_t& nExtraBits) {
+    if (value < DIRECT_BUCKETS) {
+        nExtraBits = 0;
+        return value;
+    }
+    uint32_t highBit = 4;
+    while ((value >> (highBit + 1)) != 0) {
+        highBit++;
+    }
+    nExtraBits = highBit - 1;
+    return DIRECT_BUCKETS + 2 * (highBit - 4) + ((value >> (highBit - 1)) & 1);
+}
+
+
+/* readValue
+   ---------
+   Reads a bucket symbol and its extra bits, and puts the number back
+   together. Returns false if either is cut off or not valid.
+*/
+
+inline bool LZCoder::readValue(const DecodeTable& table, BitReader& in, uint32_t& value) {
+    uint8_t bucket;
+    if (!table.decodeOne(in, bucket) || bucket > MAX_BUCKET) {
+        return false;
+    }
+    if (bucket < DIRECT_BUCKETS) {
+        value = bucket;
+        return true;
+    }
+
+    uint32_t highBit = 4 + (bucket - DIRECT_BUCKETS) / 2;
+    uint32_t nExtraBits = highBit - 1;
+    in.refill();
+    if (in.bitsRemaining() < nExtraBits) {
+        return false;
+    }
+    value = (1u << highBit) | ((uint32_t)((bucket - DIRECT_BUCKETS) & 1) << nExtraBits) | in.peek(nExtraBits);
+    in.consume(nExtraBits);
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <istream>
+#include <thread>
+
+#include "Crc32.h"
+#include "FrequencyMap.h"
+#include "HuffmanCompressor.h"
+#include "LargeInputCheck.h"
+
+
+
+/* LargeInputCheck
+   ---------------
+   Round trips of inputs bigger than 4 GiB, with nothing on disk.
+*/
+
+
+
+/* Constructor */
+
+LargeInputCheck::LargeInputCheck(uint64_t size) :
+    size(size) {
+}
+
+
+
+/* Public Interface */
+
+/* checkStream
+   -----------
+   The compressor gets its own thread and its own HuffmanCompressor, and
+   writes into the pipe while this thread decompresses out of it, so only
+   the pipe and a few blocks are ever held in memory. Whichever side
+   finishes first closes its end of the pipe, which lets the other side
+   finish too, even if it failed.
+*/
+
+bool LargeInputCheck::checkStream(ostream& out) const {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    GeneratedInput generated(size);
+    Pipe pipe;
+    ChecksumOutput checksum;
+    istream input(&generated);
+    ostream pipeOutput(&pipe);
+    istream pipeInput(&pipe);
+    ostream output(&checksum);
+
+    HuffmanCompressor compressor;
+    HuffmanCompressor decompressor;
+    bool compressed = false;
+
+    thread writer([&] {
+        compressed = compressor.compressStream(input, pipeOutput);
+        pipe.closeWriting();
+    });
+    bool decompressed = decompressor.decompressStream(pipeInput, output);
+    pipe.closeReading();
+    writer.join();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    bool matches = compressed && decompressed && checksum.size() == size && checksum.crc() == generated.crc();
+
+    out << "stream: " << size << " bytes in, " << pipe.bytesWritten() << " compressed, "
+        << checksum.size() << " out, crc " << hex << generated.crc() << " in and " << checksum.crc() << " out"
+        << dec << ", " << seconds << " s, " << (matches ? "OK" : "FAILED") << endl;
+    return matches;
+}
+
+
+/* checkCounts
+   -----------
+   Every RARE_BYTE_SPACING'th byte is a 'b' and the rest are 'a', so the
+   right counts are known without counting them any other way.
+*/
+
+bool LargeInputCheck::checkCounts(ostream& out) {
+    const size_t size = FrequencyMap::MAX_TABLE_RUN + CHUNK_SIZE + 3;
+    vector<uint8_t> data(size, 'a');
+    for (size_t i = 0; i < size; i += RARE_BYTE_SPACING) {
+        data[i] = 'b';
+    }
+
+    FrequencyMap freqMap(data.data(), data.size(), 1);
+
+    uint64_t expectedB = (size + RARE_BYTE_SPACING - 1) / RARE_BYTE_SPACING;
+    uint64_t expectedA = size - expectedB;
+    bool matches = freqMap.getFreq('a') == expectedA && freqMap.getFreq('b') == expectedB;
+    for (size_t byte = 0; byte < freqMap.size(); byte++) {
+        if (byte != 'a' && byte != 'b' && freqMap.getFreq(byte) != 0) {
+            matches = false;
+        }
+    }
+
+    out << "counts: " << size << " bytes in, " << freqMap.getFreq('a') << " a and " << freqMap.getFreq('b')
+        << " b counted, " << (matches ? "OK" : "FAILED") << endl;
+    return matches;
+}
+
+
+
+/* GeneratedInput */
+
+LargeInputCheck::GeneratedInput::GeneratedInput(uint64_t size) :
+    remaining(size),
+    chunk(CHUNK_SIZE) {
+}
+
+uint32_t LargeInputCheck::GeneratedInput::crc() const {
+    return runningCrc;
+}
+
+/* Makes up the next chunk with xorshift64, which is much faster than
+   compressing, so the check spends its time in the compressor */
+
+LargeInputCheck::GeneratedInput::int_type LargeInputCheck::GeneratedInput::underflow() {
+    if (remaining == 0) {
+        return traits_type::eof();
+    }
+
+    size_t n = (size_t)min<uint64_t>(remaining, chunk.size());
+    uint64_t mask = (nChunks % 4 == 3) ? 0x0F0F0F0F0F0F0F0F : 0xFFFFFFFFFFFFFFFF;
+    for (size_t i = 0; i < n; i += 8) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        uint64_t word = state & mask;
+        memcpy(&chunk[i], &word, min<size_t>(8, n - i));
+    }
+
+    runningCrc = Crc32::update(runningCrc, (const uint8_t*)chunk.data(), n);
+    remaining -= n;
+    nChunks++;
+    setg(chunk.data(), chunk.data(), chunk.data() + n);
+    return traits_type::to_int_type(chunk[0]);
+}
+
+
+
+/* Pipe */
+
+LargeInputCheck::Pipe::Pipe() :
+    ring(PIPE_SIZE),
+    readBuffer(CHUNK_SIZE) {
+}
+
+void LargeInputCheck::Pipe::closeWriting() {
+    lock_guard<mutex> guard(lock);
+    writingClosed = true;
+    changed.notify_all();
+}
+
+void LargeInputCheck::Pipe::closeReading() {
+    lock_guard<mutex> guard(lock);
+    readingClosed = true;
+    changed.notify_all();
+}
+
+uint64_t LargeInputCheck::Pipe::bytesWritten() {
+    lock_guard<mutex> guard(lock);
+    return nWritten;
+}
+
+/* Copies as much as fits into the ring at a time, in up to two pieces
+   when it wraps around the end */
+
+streamsize LargeInputCheck::Pipe::xsputn(const char* data, streamsize size) {
+    streamsize written = 0;
+    while (written < size) {
+        unique_lock<mutex> guard(lock);
+        changed.wait(guard, [this] { return used < ring.size() || readingClosed; });
+        if (readingClosed) {
+            break;
+        }
+
+        size_t tail = (head + used) % ring.size();
+        size_t n = min((size_t)(size - written), ring.size() - used);
+        size_t firstPiece = min(n, ring.size() - tail);
+        memcpy(&ring[tail], data + written, firstPiece);
+        memcpy(&ring[0], data + written + firstPiece, n - firstPiece);
+
+        used += n;
+        nWritten += n;
+        written += n;
+        changed.notify_all();
+    }
+    return written;
+}
+
+LargeInputCheck::Pipe::int_type LargeInputCheck::Pipe::overflow(int_type c) {
+    if (traits_type::eq_int_type(c, traits_type::eof())) {
+        return traits_type::not_eof(c);
+    }
+    char byte = traits_type::to_char_type(c);
+    return (xsputn(&byte, 1) == 1) ? c : traits_type::eof();
+}
+
+LargeInputCheck::Pipe::int_type LargeInputCheck::Pipe::underflow() {
+    unique_lock<mutex> guard(lock);
+    changed.wait(guard, [this] { return used > 0 || writingClosed; });
+    if (used == 0) {
+        return traits_type::eof();
+    }
+
+    size_t n = min(used, readBuffer.size());
+    size_t firstPiece = min(n, ring.size() - head);
+    memcpy(&readBuffer[0], &ring[head], firstPiece);
+    memcpy(&readBuffer[firstPiece], &ring[0], n - firstPiece);
+
+    head = (head + n) % ring.size();
+    used -= n;
+    changed.notify_all();
+
+    setg(readBuffer.data(), readBuffer.data(), readBuffer.data() + n);
+    return traits_type::to_int_type(readBuffer[0]);
+}
+
+
+
+/* ChecksumOutput */
+
+uint64_t LargeInputCheck::ChecksumOutput::size() const {
+    return nWritten;
+}
+
+uint32_t LargeInputCheck::ChecksumOutput::crc() const {
+    return runningCrc;
+}
+
+streamsize LargeInputCheck::ChecksumOutput::xsputn(const char* data, streamsize size) {
+    runningCrc = Crc32::update(runningCrc, (const uint8_t*)data, (size_t)size);
+    nWritten += size;
+    return size;
+}
+
+LargeInputCheck::ChecksumOutput::int_type LargeInputCheck::ChecksumOutput::overflow(int_type c) {
+    if (traits_type::eq_int_type(c, traits_type::eof())) {
+        return traits_type::not_eof(c);
+    }
+    char byte = traits_type::to_char_type(c);
+    xsputn(&byte, 1);
+    return c;
+}
\ No newline at end of file
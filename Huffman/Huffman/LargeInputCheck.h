@@ -0,0 +1,171 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+using namespace std;
+
+
+
+/* LargeInputCheck
+   ---------------
+   Checks that inputs too big for 32-bit sizes and offsets come back out
+   exactly as they went in, without the disk space or memory to hold
+   them. A generated input is compressed by compressStream on one thread
+   and piped straight into decompressStream on this one, and the CRC of
+   what went in is compared with the CRC of what came out.
+
+   The input is random bytes, except that every fourth chunk only uses
+   sixteen byte values, so most blocks are stored and the rest are coded.
+   The compressed data is then nearly as big as the input, so at the
+   default size both the block offsets and the output run past 4 GiB.
+
+   Streams give every block its own codes, so they never count more
+   than a block at a time. Counting is checked on its own instead: one
+   thread counts a buffer just over FrequencyMap::MAX_TABLE_RUN bytes,
+   so its 32-bit tables have to be added into the 64-bit counts part
+   way through.
+*/
+
+
+
+class LargeInputCheck {
+public:
+
+    /* Constants */
+
+    static const uint64_t DEFAULT_SIZE = (uint64_t)5 << 30;
+
+
+    /* Constructor */
+
+    LargeInputCheck(uint64_t size = DEFAULT_SIZE);
+
+
+    /* Public Interface */
+
+
+    /* checkStream
+       -----------
+       Round trips size bytes of generated input through compressStream
+       and decompressStream. Writes the sizes, checksums and time taken
+       to out. Returns false if the output is not the input.
+    */
+
+    bool checkStream(ostream& out) const;
+
+
+    /* checkCounts
+       -----------
+       Counts a buffer just over MAX_TABLE_RUN bytes long, of two byte
+       values, with one thread. Writes the counts to out. Returns false
+       if any of them is wrong.
+    */
+
+    static bool checkCounts(ostream& out);
+
+
+private:
+
+    /* Constants */
+
+    static const size_t CHUNK_SIZE = 1 << 20;
+    static const size_t PIPE_SIZE = 16 << 20;
+    static const size_t RARE_BYTE_SPACING = 4099;
+
+
+    /* GeneratedInput
+       --------------
+       A stream buffer that makes up the input a chunk at a time, as it
+       is read, and keeps a CRC of everything it has handed out.
+    */
+
+    class GeneratedInput : public streambuf {
+    public:
+        GeneratedInput(uint64_t size);
+
+        uint32_t crc() const;
+
+    protected:
+        int_type underflow() override;
+
+    private:
+        uint64_t remaining;
+        uint64_t nChunks = 0;
+        uint64_t state = 0x9E3779B97F4A7C15;
+        uint32_t runningCrc = 0;
+        vector<char> chunk;
+    };
+
+
+    /* Pipe
+       ----
+       A stream buffer that one thread writes into and another reads out
+       of, through a ring of PIPE_SIZE bytes. Writes wait while the ring
+       is full and reads wait while it is empty. Once the writer closes
+       it, reads find the end of the stream when the ring runs dry, and
+       once the reader closes it, writes fail, so neither side can be
+       left waiting on the other.
+    */
+
+    class Pipe : public streambuf {
+    public:
+        Pipe();
+
+        void closeWriting();
+
+        void closeReading();
+
+        uint64_t bytesWritten();
+
+    protected:
+        streamsize xsputn(const char* data, streamsize size) override;
+
+        int_type overflow(int_type c) override;
+
+        int_type underflow() override;
+
+    private:
+        mutex lock;
+        condition_variable changed;
+        vector<char> ring;
+        size_t head = 0;
+        size_t used = 0;
+        bool writingClosed = false;
+        bool readingClosed = false;
+        uint64_t nWritten = 0;
+        vector<char> readBuffer;
+    };
+
+
+    /* ChecksumOutput
+       --------------
+       A stream buffer that throws away everything written to it, but
+       keeps its size and a CRC of it.
+    */
+
+    class ChecksumOutput : public streambuf {
+    public:
+        uint64_t size() const;
+
+        uint32_t crc() const;
+
+    protected:
+        streamsize xsputn(const char* data, streamsize size) override;
+
+        int_type overflow(int_type c) override;
+
+    private:
+        uint64_t nWritten = 0;
+        uint32_t runningCrc = 0;
+    };
+
+
+    /* Private Variables */
+
+    uint64_t size;
+
+};
\ No newline at end of file
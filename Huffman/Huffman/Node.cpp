@@ -1,6 +1,6 @@
 #include "Node.h"
 
-Node::Node(uint8_t ch, uint32_t freq) :
+Node::Node(uint8_t ch, uint64_t freq) :
     byte(ch), freq(freq) {
     isLeaf = true;
 }
@@ -8,7 +8,7 @@ Node::Node(uint8_t ch, uint32_t freq) :
 /* Creating a node with a right/left pointer means
    it is a parent Node and thus not a Leaf */
 
-Node::Node(uint32_t freq, Node* left, Node* right) :
+Node::Node(uint64_t freq, Node* left, Node* right) :
     freq(freq), left(left), right(right) {
     isLeaf = false;
 }
@@ -25,7 +25,7 @@ Node::Node(Node* n) {
 
 bool isLeaf = false;
 uint8_t ch = 0;
-uint32_t freq = 0;
+uint64_t freq = 0;
 Node* left = nullptr;
 Node* right = nullptr;
 
@@ -34,22 +34,4 @@ Node* right = nullptr;
 bool Node::operator > (Node const& n) { return freq > n.freq; }
 bool Node::operator < (Node const& n) { return freq < n.freq; }
 bool Node::operator >= (Node const& n) { return freq >= n.freq; }
-bool Node::operator <= (Node const& n) { return freq <= n.freq; }
-
-/* Functions */
-
-/* destroyNode
-   -----------
-   Destroys all child nodes before self.
-   */
-
-void Node::destroyNode(Node* node) {
-    if (node->isLeaf) {
-        delete node;
-    }
-    else {
-        destroyNode(node->left);
-        destroyNode(node->right);
-        delete node;
-    }
-}
\ No newline at end of file
+bool Node::operator <= (Node const& n) { return freq <= n.freq; }
\ No newline at end of file
@@ -20,9 +20,9 @@ public:
 
     /* Constructors */
 
-    Node(uint8_t ch, uint32_t freq);
+    Node(uint8_t ch, uint64_t freq);
 
-    Node(uint32_t freq, Node* left, Node* right);
+    Node(uint64_t freq, Node* left, Node* right);
 
     Node(Node* n);
 
@@ -31,7 +31,7 @@ public:
 
     bool isLeaf;
     uint8_t byte = 0;
-    uint32_t freq = 0;
+    uint64_t freq = 0;
     Node* left = nullptr;
     Node* right = nullptr;
 
@@ -43,15 +43,5 @@ public:
     bool operator >= (Node const& n);
     bool operator <= (Node const& n);
 
-
-    /* Methods */
-
-
-    /* destroyNode
-       -----------
-       Destroys all child nodes before destroying self.
-       */
-
-    static void destroyNode(Node* node);
 };
 
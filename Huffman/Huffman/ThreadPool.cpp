@@ -0,0 +1,96 @@
+#include "ThreadPool.h"
+
+
+
+/* ThreadPool
+   ----------
+   Worker threads that pull tasks off a shared queue.
+*/
+
+
+
+/* Constructor/Destructor */
+
+ThreadPool::ThreadPool(size_t nThreads) {
+    if (nThreads == 0) {
+        nThreads = 1;
+    }
+    for (size_t i = 0; i < nThreads; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+/* Lets the workers finish whatever is still queued, then joins them */
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(queueMutex);
+        stopping = true;
+    }
+    taskReady.notify_all();
+    for (thread& worker : workers) {
+        worker.join();
+    }
+}
+
+
+
+/* Public Interface */
+
+void ThreadPool::submit(function<void()> task) {
+    {
+        lock_guard<mutex> lock(queueMutex);
+        tasks.push(move(task));
+        nUnfinished++;
+    }
+    taskReady.notify_one();
+}
+
+void ThreadPool::wait() {
+    unique_lock<mutex> lock(queueMutex);
+    allDone.wait(lock, [this] { return nUnfinished == 0; });
+}
+
+size_t ThreadPool::size() const {
+    return workers.size();
+}
+
+size_t ThreadPool::defaultThreadCount() {
+    size_t nThreads = thread::hardware_concurrency();
+    return (nThreads == 0) ? 1 : nThreads;
+}
+
+
+
+/* Private Methods */
+
+/* workerLoop
+   ----------
+   Runs tasks until the pool is being destroyed and the queue is
+   empty. The last task to finish wakes up anyone waiting on wait().
+*/
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        function<void()> task;
+        {
+            unique_lock<mutex> lock(queueMutex);
+            taskReady.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty()) {
+                return;
+            }
+            task = move(tasks.front());
+            tasks.pop();
+        }
+
+        task();
+
+        {
+            lock_guard<mutex> lock(queueMutex);
+            nUnfinished--;
+            if (nUnfinished == 0) {
+                allDone.notify_all();
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,86 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+
+
+/* ThreadPool
+   ----------
+   A fixed set of worker threads that take tasks off a shared queue.
+   Used to compress or decompress independent blocks of a file at
+   the same time.
+*/
+
+
+
+class ThreadPool {
+public:
+
+    /* Constructor/Destructor */
+
+    ThreadPool(size_t nThreads);
+
+    ~ThreadPool();
+
+
+    /* Public Interface */
+
+
+    /* submit
+       ------
+       Queues a task to be run by the next free worker.
+    */
+
+    void submit(function<void()> task);
+
+
+    /* wait
+       ----
+       Blocks until every task submitted so far has finished.
+    */
+
+    void wait();
+
+
+    /* size
+       ----
+       Returns the number of worker threads.
+    */
+
+    size_t size() const;
+
+
+    /* defaultThreadCount
+       ------------------
+       Returns the number of hardware threads, or 1 if that is unknown.
+    */
+
+    static size_t defaultThreadCount();
+
+
+private:
+
+    /* Private Variables */
+
+    vector<thread> workers;
+    queue<function<void()>> tasks;
+
+    mutex queueMutex;
+    condition_variable taskReady;
+    condition_variable allDone;
+
+    size_t nUnfinished = 0;
+    bool stopping = false;
+
+
+    /* Private Methods */
+
+    void workerLoop();
+
+};
\ No newline at end of file
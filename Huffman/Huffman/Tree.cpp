@@ -1,5 +1,5 @@
+#include <algorithm>
 #include <iostream>
-#include <list>
 #include <stack>
 
 #include "Node.h"
@@ -13,18 +13,23 @@ using namespace std;
    ----
    Stores a pointer to the root of a binary tree. Also
    knows how to write to and decode itself from a file.
+
+   Every node lives in one vector that is sized up front for the
+   largest possible tree, so pointers between nodes stay valid and
+   the whole tree is freed at once along with the vector.
 */
 
 
 
-/* Constructors/Destructor */
+/* Constructors */
 
-Tree::Tree(FrequencyMap freqMap) {
-    createBinaryTree(freqMap);
+/* An empty tree, to be filled in by decompressTree */
+
+Tree::Tree() {
 }
 
-Tree::~Tree() {
-    Node::destroyNode(root);
+Tree::Tree(const FrequencyMap& freqMap) {
+    createBinaryTree(freqMap);
 }
 
 
@@ -40,43 +45,64 @@ Tree::~Tree() {
    to its frequency in the file. All of the higher frequency nodes will 
    be added higher in the tree. Lower frequency values are added first, 
    meaning they are deeper into the tree and will have longer bit representations.
+
+   The leaves are sorted by frequency once. Every parent made after that
+   is at least as frequent as the one before it, so the parents come out
+   sorted as well, and the two lowest frequency nodes are always at the
+   front of either the leaves or the parents. No re-sorting is needed
+   between merges.
    */
 
-void Tree::createBinaryTree(FrequencyMap freqMap) {
+void Tree::createBinaryTree(const FrequencyMap& freqMap) {
+    nodes.reserve(MAX_NODES);
 
     /* Iterate through the map and make a Node for each one */
 
-    list<Node> nodes;
     for (size_t index = 0; index < freqMap.size(); index++) {
         uint8_t byte = (uint8_t)index;
-        uint32_t freq = freqMap.getFreq(index);
+        uint64_t freq = freqMap.getFreq(index);
         if (freq != 0) {
             nodes.push_back(Node(byte, freq));
         }
     }
 
+    /* An empty file still gets a tree with a single leaf, so there is always a root */
+
+    if (nodes.empty()) {
+        nodes.push_back(Node((uint8_t)0, 0));
+    }
+
+    //Sort the leaves lowest to highest by frequency
+    stable_sort(nodes.begin(), nodes.end(), [](const Node& a, const Node& b) {
+        return a.freq < b.freq;
+    });
+
     /* Binary Tree Creation Loop */
 
-    while (nodes.size() > 1) {
+    const size_t nLeaves = nodes.size();
+    size_t nextLeaf = 0;
+    size_t nextParent = nLeaves;
 
-        //Sort elements lowest to highest by frequency
-        nodes.sort();
+    auto takeLowest = [&]() {
+        if (nextLeaf < nLeaves && (nextParent == nodes.size() || nodes[nextLeaf].freq <= nodes[nextParent].freq)) {
+            return &nodes[nextLeaf++];
+        }
+        return &nodes[nextParent++];
+    };
+
+    while (nodes.size() < nLeaves * 2 - 1) {
 
         //Take the 2 lowest frequency elements
-        Node* first = new Node(nodes.front());
-        nodes.pop_front();
-        Node* second = new Node(nodes.front());
-        nodes.pop_front();
-
-        //Add back a new Node with the combined frequency of the children
-        Node parent(first->freq + second->freq, first, second);
-        nodes.push_back(parent);
+        Node* first = takeLowest();
+        Node* second = takeLowest();
+
+        //Add a new Node with the combined frequency of the children
+        nodes.push_back(Node(first->freq + second->freq, first, second));
     }
 
     /* Set the root of the tree */
 
-    root = new Node(nodes.front());
-    nodes.pop_front(); //now empty
+    root = &nodes.back();
 }
 
 
@@ -162,6 +188,42 @@ Tree::bitRep Tree::findBitRepOf(const uint8_t byte) {
 
 
 
+/* getCodeLengths
+   --------------
+   Finds the length of every byte's bit representation in one walk.
+   Like findBitRepOf, a tree that is only a root leaf gives its byte
+   a length of 1.
+*/
+
+void Tree::getCodeLengths(uint8_t lengths[256]) const {
+    fill(lengths, lengths + 256, (uint8_t)0);
+    if (root->isLeaf) {
+        lengths[root->byte] = 1;
+    }
+    else {
+        getCodeLengthsRecursive(root, 0, lengths);
+    }
+}
+
+
+/* getCodeLengthsRecursive
+   -----------------------
+   Stepping left or right adds one to the depth. When we reach a
+   leaf, the depth is the length of its bit representation.
+*/
+
+void Tree::getCodeLengthsRecursive(const Node* node, uint8_t depth, uint8_t lengths[256]) const {
+    if (node->isLeaf) {
+        lengths[node->byte] = depth;
+    }
+    else {
+        getCodeLengthsRecursive(node->left, depth + 1, lengths);
+        getCodeLengthsRecursive(node->right, depth + 1, lengths);
+    }
+}
+
+
+
 /* Decompression Methods */
 
 /* DecompressTree
@@ -181,33 +243,41 @@ Tree::bitRep Tree::findBitRepOf(const uint8_t byte) {
 */
 
 void Tree::decompressTree(ifstream& infile) {
+    nodes.reserve(MAX_NODES);
+
     stack<Node*> s;
     char ch;
     uint8_t sentinel, byte;
-    while (true) {
+    while (infile.get(ch)) {
 
         //get the sentinel for the next Node
-        infile.get(ch);
         sentinel = (uint8_t)ch;
 
+        if (nodes.size() == MAX_NODES) {
+            break; //more nodes than any tree can have, the file is corrupt
+        }
+
         if (sentinel == LEAF) {
             //get the byte after the sentinel value
             infile.get(ch);
             byte = (uint8_t)ch;
-            Node* leaf = new Node(byte, 0); //frequency, or the second parameter here, does not matter in this tree
-            s.push(leaf);
+            nodes.push_back(Node(byte, 0)); //frequency, or the second parameter here, does not matter in this tree
+            s.push(&nodes.back());
         }
         else if (sentinel == NODE) {
             //get the next value which is not used.
             infile.get(ch);
+            if (s.size() < 2) {
+                break;
+            }
             Node* right = s.top(); s.pop();
             Node* left = s.top(); s.pop();
-            Node* node = new Node(0, left, right); //leaving freq empty
-            s.push(node);
+            nodes.push_back(Node(0, left, right)); //leaving freq empty
+            s.push(&nodes.back());
         }
         else if (sentinel == DATA) {
             break;
         }
     }
-    root = s.top();
-}
+    root = s.empty() ? nullptr : s.top();
+}
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 #include <cstdint>
 #include <fstream>
+#include <vector>
 
 #include "FrequencyMap.h"
 #include "Node.h"
@@ -29,11 +30,19 @@ public:
     static const uint8_t LEAF = 1;
     static const uint8_t DATA = 2;
 
-    /* Constructors/Destructor */
+    /* Constants */
 
-    Tree(FrequencyMap freqMap);
+    static const size_t MAX_NODES = 2 * 256 - 1;
 
-    ~Tree();
+    /* Constructors */
+
+    Tree();
+
+    Tree(const FrequencyMap& freqMap);
+
+    Tree(const Tree&) = delete;
+
+    Tree& operator=(const Tree&) = delete;
 
 
     /* Variables */
@@ -87,8 +96,23 @@ public:
     bitRep findBitRepOf(const uint8_t byte);
 
 
+    /* getCodeLengths
+       --------------
+       Fills lengths with the depth of each byte's leaf in the tree,
+       which is the length of its bit representation, or 0 if it is
+       not in the tree.
+    */
+
+    void getCodeLengths(uint8_t lengths[256]) const;
+
+
 private:
 
+    /* Private Variables */
+
+    vector<Node> nodes;
+
+
     /* Private Methods */
 
     /* writeNode
@@ -106,7 +130,7 @@ private:
        for each byte of data.
     */
 
-    void createBinaryTree(FrequencyMap freqMap);
+    void createBinaryTree(const FrequencyMap& freqMap);
 
 
     /* findBitRepOfByteRecursive 
@@ -117,6 +141,14 @@ private:
 
     void findBitRepOfByteRecursive(const uint8_t byte, Node* node, bitRep temp, bitRep& result);
 
+
+    /* getCodeLengthsRecursive
+       -----------------------
+       Records the depth of every leaf below node.
+    */
+
+    void getCodeLengthsRecursive(const Node* node, uint8_t depth, uint8_t lengths[256]) const;
+
 };
 
 
@@ -0,0 +1,118 @@
+#include <thread>
+
+#include "WorkStealingPool.h"
+
+
+
+/* WorkStealingPool
+   ----------------
+   Threads that each run their own share of the tasks, then steal.
+*/
+
+
+
+/* Constructor */
+
+WorkStealingPool::WorkStealingPool(size_t nThreads) :
+    nThreads((nThreads == 0) ? 1 : nThreads) {
+    for (size_t i = 0; i < this->nThreads; i++) {
+        shares.emplace_back(new Share());
+    }
+}
+
+
+
+/* Public Interface */
+
+/* run
+   ---
+   Splits the tasks into one even, contiguous share per thread, then
+   starts the threads. The calling thread runs as thread 0.
+*/
+
+void WorkStealingPool::run(size_t nTasks, const function<void(size_t, size_t)>& task) {
+    for (size_t i = 0; i < nThreads; i++) {
+        shares[i]->next = nTasks * i / nThreads;
+        shares[i]->end = nTasks * (i + 1) / nThreads;
+    }
+
+    vector<thread> workers;
+    for (size_t i = 1; i < nThreads; i++) {
+        workers.emplace_back(&WorkStealingPool::workerLoop, this, i, cref(task));
+    }
+    workerLoop(0, task);
+    for (thread& worker : workers) {
+        worker.join();
+    }
+}
+
+size_t WorkStealingPool::size() const {
+    return nThreads;
+}
+
+
+
+/* Private Methods */
+
+/* workerLoop
+   ----------
+   Runs tasks from this thread's own share, and steals more whenever it
+   runs dry. Tasks never make new tasks, so once there is nothing left
+   to steal anywhere, this thread is done.
+*/
+
+void WorkStealingPool::workerLoop(size_t worker, const function<void(size_t, size_t)>& task) {
+    size_t next;
+    while (takeTask(worker, next) || (stealTasks(worker) && takeTask(worker, next))) {
+        task(worker, next);
+    }
+}
+
+
+/* takeTask
+   --------
+   Takes the next task off the front of this thread's share.
+*/
+
+bool WorkStealingPool::takeTask(size_t worker, size_t& task) {
+    Share& share = *shares[worker];
+    lock_guard<mutex> lock(share.lock);
+    if (share.next == share.end) {
+        return false;
+    }
+    task = share.next++;
+    return true;
+}
+
+
+/* stealTasks
+   ----------
+   Looks through the other threads' shares, starting with the next
+   thread along, and moves the back half of the first one that has any
+   tasks left into this thread's share. Returns false if there were
+   none left anywhere.
+*/
+
+bool WorkStealingPool::stealTasks(size_t worker) {
+    for (size_t i = 1; i < nThreads; i++) {
+        Share& victim = *shares[(worker + i) % nThreads];
+        size_t first;
+        size_t last;
+        {
+            lock_guard<mutex> lock(victim.lock);
+            if (victim.next == victim.end) {
+                continue;
+            }
+            last = victim.end;
+            first = last - (last - victim.next + 1) / 2;
+            victim.end = first;
+        }
+
+        Share& own = *shares[worker];
+        lock_guard<mutex> lock(own.lock);
+        own.next = first;
+        own.end = last;
+        return true;
+    }
+    return false;
+}
\ No newline at end of file
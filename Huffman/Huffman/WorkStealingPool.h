@@ -0,0 +1,84 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+
+
+/* WorkStealingPool
+   ----------------
+   Runs a known number of independent tasks on a fixed number of
+   threads. Each thread starts with its own share of the tasks and
+   works through it from the front. A thread that runs out steals half
+   of what is left from the back of another thread's share, so a few
+   slow tasks never leave the other threads idle at the end, and the
+   threads hardly ever touch the same lock.
+
+   Each task is told which thread is running it, so every thread can
+   keep scratch memory of its own and reuse it from task to task.
+*/
+
+
+
+class WorkStealingPool {
+public:
+
+    /* Constructor */
+
+    WorkStealingPool(size_t nThreads);
+
+
+    /* Public Interface */
+
+
+    /* run
+       ---
+       Calls task(worker, i) for every i from 0 to nTasks - 1, and
+       returns once all of them have finished. worker is the thread
+       running the task, from 0 to size() - 1. The threads only live
+       for as long as run does.
+    */
+
+    void run(size_t nTasks, const function<void(size_t, size_t)>& task);
+
+
+    /* size
+       ----
+       Returns the number of threads.
+    */
+
+    size_t size() const;
+
+
+private:
+
+    /* Share
+       -----
+       The tasks from next up to end that one thread has yet to run.
+    */
+
+    struct Share {
+        mutex lock;
+        size_t next = 0;
+        size_t end = 0;
+    };
+
+
+    /* Private Variables */
+
+    size_t nThreads;
+    vector<unique_ptr<Share>> shares;
+
+
+    /* Private Methods */
+
+    void workerLoop(size_t worker, const function<void(size_t, size_t)>& task);
+
+    bool takeTask(size_t worker, size_t& task);
+
+    bool stealTasks(size_t worker);
+
+};
\ No newline at end of file